@@ -2,7 +2,10 @@
 #define PT_ACCELATORS_BVH_H
 
 #include <vector>
+#include <stdexcept>
 #include <pt/math/bounds3.h>
+#include <pt/core/stats.h>
+#include <pt/core/memory.h>
 #include <pt/core/primitive.h>
 
 namespace pt {
@@ -10,13 +13,15 @@ namespace pt {
 class BVHNode;
 class PrimInfo;
 
-struct LinearBVHNode {
+// siblings are always stored side by side, with float a node is half a cache line, so a
+// pair of siblings fills exactly one line, with PT_FLOAT_AS_DOUBLE every node takes a line
+struct alignas(sizeof(Float) * 8) LinearBVHNode {
     Bounds3 bounds;
     uint16_t nPrims;
     uint16_t splitAxis;
     union {
         int primsOffset;
-        int rightChild;
+        int childrenOffset;     // left child at childrenOffset, right child at childrenOffset + 1
     };
 
     // leaf node constructor
@@ -30,6 +35,28 @@ struct LinearBVHNode {
     { }
 };
 
+static_assert(sizeof(LinearBVHNode) == sizeof(Float) * 8 && CacheLineSize % sizeof(LinearBVHNode) == 0,
+              "BVH nodes must tile cache lines");
+
+#ifdef PT_BVH_COMPRESSED
+// child bounds are stored as 8-bit fractions of the parent's decoded bounds, rounded
+// outwards so that a decoded box always contains the exact one
+struct CompressedBVHNode {
+    uint8_t qMin[3];
+    uint8_t qMax[3];
+    uint16_t nPrims;
+    uint32_t offset : 30;   // primsOffset for leaf nodes, childrenOffset for interior nodes
+    uint32_t splitAxis : 2;
+};
+#endif
+
+struct RayHit {
+    Float t;                        // ray.tMax if nothing was hit
+    Vector3 p;
+    Vector3 n;
+    const Primitive* primitive;     // nullptr if nothing was hit
+};
+
 class BVHAccel : public Primitive {
 public:
     BVHAccel(std::vector<Primitive*>&& prims) noexcept;
@@ -41,13 +68,26 @@ public:
     }
 
     Bounds3 worldBound() const override {
+#ifdef PT_BVH_COMPRESSED
+        return rootBounds;
+#else
         return nodes[0].bounds;
+#endif
     }
 
     bool intersect(const Ray& ray, Interaction& isect) const override;
 
     bool intersect(const Ray& ray) const override;
 
+    void intersect(RayPacket<PacketSize>& packet, Interaction* isects) const override;
+
+    // batch queries for independent rays, the rays are reordered by direction octant and
+    // origin internally and traced on the thread pool
+    void intersect(const Ray* rays, RayHit* hits, int64_t count) const;
+
+    // bit i % 32 of occludedBits[i / 32] is set if rays[i] hits anything
+    void occluded(const Ray* rays, std::uint32_t* occludedBits, int64_t count) const;
+
     const Material* getMaterial() const override {
         throw std::runtime_error("Only ShapePrimitive supports getMaterial methods!");
     };
@@ -64,31 +104,51 @@ private:
     BVHNode* createLeafNode(
         std::vector<PrimInfo>& primInfos,
         int start, int end, int& totalNodes,
-        std::vector<Primitive*>& orderedPrims) const;
+        std::vector<int>& orderedIds) const;
 
     BVHNode* exhaustBuild(
         std::vector<PrimInfo>& primInfos,
         int start, int end, int& totalNodes,
-        std::vector<Primitive*>& orderedPrims) const;
+        std::vector<int>& orderedIds) const;
 
     BVHNode* sahBuild(
         std::vector<PrimInfo>& primInfos,
         int start, int end, int& totalNodes,
-        std::vector<Primitive*>& orderedPrims) const;
+        std::vector<int>& orderedIds) const;
 
     void destroyBVHTree(const BVHNode* node) const;
 
-    void flattenBVHTree(const BVHNode* node);
+    void addLinearNode(const BVHNode* node);
+
+    void flattenBVHTree(const BVHNode* root);
 
+#ifdef PT_BVH_COMPRESSED
+    void compressBVHTree();
+#endif
+
+    // calls visitLeaf(primsOffset, nPrims) for every leaf the ray hits, in front to back order,
+    // until visitLeaf returns true
+    template <typename Visitor>
+    bool traverse(const Ray& ray, RayStats& rayStats, Visitor&& visitLeaf) const;
+
+    std::vector<int64_t> sortRaysForCoherence(const Ray* rays, int64_t count) const;
 
 public:
     static constexpr int BUCKETS = 16;
     static constexpr int SAH_APPLY_COUNT = 32;
     static constexpr Float AABB_SHAPE_INTERSECT_COST_RATIO = (Float)1 / 4;
+    static constexpr int TREELET_BYTES = 4096;
+    static constexpr int TREELET_PAIRS = TREELET_BYTES / (2 * sizeof(LinearBVHNode));
+    static constexpr int RAY_STREAM_CHUNK_SIZE = 1024;
 
 private:
     std::vector<Primitive*> primitives;
-    std::vector<LinearBVHNode> nodes;
+    std::vector<int> primitiveIds;      // index of each primitive in the constructor's input
+    std::vector<LinearBVHNode, AlignedAllocator<LinearBVHNode>> nodes;
+#ifdef PT_BVH_COMPRESSED
+    std::vector<CompressedBVHNode, AlignedAllocator<CompressedBVHNode>> compressedNodes;
+    Bounds3 rootBounds;
+#endif
 };
 
 }
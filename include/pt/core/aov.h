@@ -0,0 +1,111 @@
+#ifndef PT_CORE_AOV_H
+#define PT_CORE_AOV_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <pt/core/ray.h>
+#include <pt/core/interaction.h>
+
+namespace pt {
+
+// arbitrary output variables, filled by the integrator next to the radiance of a camera
+// sample and written as layers of the film's EXR file
+enum AOV {
+    AOVDepth,           // distance from the camera to the first hit, 0 for misses
+    AOVNormal,          // surface normal at the first hit
+    AOVAlbedo,          // reflectance at the first hit
+    AOVPrimitiveId,     // index of the first primitive hit in the accelerator's input, -1 for misses
+    AOVDirect,          // emission seen by the camera plus light arriving after one bounce
+    AOVIndirect,        // the rest of the radiance, direct plus indirect is the image
+    AOVMoment,          // squared luminance of the radiance, gives the pixel variance for denoising
+    AOVCount
+};
+
+inline Float luminance(const Vector3& rgb) {
+    return (Float)0.2126 * rgb.x + (Float)0.7152 * rgb.y + (Float)0.0722 * rgb.z;
+}
+
+struct AOVInfo {
+    const char* name;
+    std::vector<std::string> channels;
+};
+
+inline const AOVInfo& getAOVInfo(AOV aov) {
+    static const AOVInfo infos[AOVCount] = {
+        { "depth", { "Z" } },
+        { "N", { "X", "Y", "Z" } },
+        { "albedo", { "R", "G", "B" } },
+        { "primId", { "id" } },
+        { "direct", { "R", "G", "B" } },
+        { "indirect", { "R", "G", "B" } },
+        { "moment", { "L2" } }
+    };
+    return infos[aov];
+}
+
+// values of the enabled AOVs for one camera sample, single channel AOVs use x
+class AOVSample {
+public:
+    explicit AOVSample(std::uint32_t enabled = 0) noexcept : enabled(enabled)
+    { }
+
+    bool wants(AOV aov) const {
+        return (enabled >> aov) & 1;
+    }
+
+    void set(AOV aov, const Vector3& value) {
+        values[aov] = value;
+    }
+
+    const Vector3& get(AOV aov) const {
+        return values[aov];
+    }
+
+    // the AOVs every integrator can fill from the first intersection
+    void setGeometry(const Ray& ray, const Interaction& isect, bool foundIntersection) {
+        if (!enabled) return;
+        set(AOVDepth, Vector3(foundIntersection ? (isect.p - ray.o).length() : 0));
+        set(AOVNormal, foundIntersection ? isect.n : Vector3(0));
+        set(AOVPrimitiveId, Vector3(foundIntersection ? (Float)isect.primitiveId : -1));
+    }
+
+public:
+    const std::uint32_t enabled;
+
+private:
+    Vector3 values[AOVCount] = {
+        Vector3(0), Vector3(0), Vector3(0), Vector3(0), Vector3(0), Vector3(0), Vector3(0)
+    };
+};
+
+// where the enabled AOVs are stored in the interleaved AOV values of a pixel
+struct AOVLayout {
+    AOVLayout() noexcept {
+        for (auto& offset : offsets) offset = -1;
+    }
+
+    void enable(AOV aov) {
+        if ((enabled >> aov) & 1) return;
+        enabled |= 1u << aov;
+        offsets[aov] = nValues;
+        nValues += (int)getAOVInfo(aov).channels.size();
+    }
+
+    void add(Float* values, const AOVSample& sample, Float weight) const {
+        for (auto aov = 0; aov < AOVCount; ++aov) {
+            if (offsets[aov] < 0) continue;
+            auto& value = sample.get((AOV)aov);
+            auto nChannels = (int)getAOVInfo((AOV)aov).channels.size();
+            for (auto c = 0; c < nChannels; ++c) values[offsets[aov] + c] += value[c] * weight;
+        }
+    }
+
+    std::uint32_t enabled = 0;
+    int nValues = 0;
+    int offsets[AOVCount];
+};
+
+}
+
+#endif
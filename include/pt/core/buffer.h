@@ -0,0 +1,86 @@
+#ifndef PT_CORE_BUFFER_H
+#define PT_CORE_BUFFER_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace pt {
+
+// read only array that either owns its elements or borrows memory kept alive by owner,
+// e.g. a mapped file whose page cache copy is shared by several processes
+template <typename T>
+class Buffer {
+public:
+    Buffer() noexcept = default;
+
+    Buffer(std::vector<T>&& data) noexcept
+        : owned(std::move(data)), ptr(owned.data()), count(owned.size())
+    { }
+
+    Buffer(const T* data, std::size_t count, std::shared_ptr<const void> owner) noexcept
+        : ptr(data), count(count), owner(std::move(owner))
+    { }
+
+    Buffer(const Buffer& buffer)
+        : owned(buffer.owned)
+        , ptr(buffer.owner ? buffer.ptr : owned.data())
+        , count(buffer.count)
+        , owner(buffer.owner)
+    { }
+
+    Buffer(Buffer&& buffer) noexcept
+        : owned(std::move(buffer.owned))
+        , ptr(buffer.owner ? buffer.ptr : owned.data())
+        , count(buffer.count)
+        , owner(std::move(buffer.owner)) {
+        buffer.ptr = nullptr;
+        buffer.count = 0;
+    }
+
+    Buffer& operator=(Buffer buffer) noexcept {
+        owned.swap(buffer.owned);
+        owner.swap(buffer.owner);
+        ptr = owner ? buffer.ptr : owned.data();
+        count = buffer.count;
+        return *this;
+    }
+
+    const T& operator[](std::size_t i) const {
+        return ptr[i];
+    }
+
+    const T* data() const {
+        return ptr;
+    }
+
+    const T* begin() const {
+        return ptr;
+    }
+
+    const T* end() const {
+        return ptr + count;
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    bool isBorrowed() const {
+        return owner != nullptr;
+    }
+
+private:
+    std::vector<T> owned;
+    const T* ptr = nullptr;
+    std::size_t count = 0;
+    std::shared_ptr<const void> owner;
+};
+
+}
+
+#endif
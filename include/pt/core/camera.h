@@ -10,6 +10,7 @@ namespace pt {
 struct CameraSample {
     Vector2f pFilm;
     Vector2f pLens;
+    Float filterWeight = 1;
 };
 
 class Camera {
@@ -0,0 +1,114 @@
+#ifndef PT_CORE_CHECKPOINT_H
+#define PT_CORE_CHECKPOINT_H
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <pt/core/film.h>
+
+namespace pt {
+
+// how far a render has come, passes are rendered with the sampler's seed so that a
+// resumed render takes the same samples as an uninterrupted one, identity is a hash of
+// the scene, camera and integrator the passes were rendered with
+struct RenderProgress {
+    std::int64_t samplesPerPixel;
+    std::int64_t samplesPerPass;
+    std::int64_t completedPasses;
+    std::uint64_t seed;
+    std::uint64_t identity;
+};
+
+// FNV-1a, hash is the hash of the bytes before these
+inline std::uint64_t hashBytes(const void* data, std::size_t size, std::uint64_t hash = 0xcbf29ce484222325ull) {
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+// fixed size header followed by the film's state
+struct CheckpointHeader {
+    char magic[4];
+    std::uint32_t floatSize;
+    std::int32_t pixelBounds[4];
+    std::uint32_t aovMask;
+    std::uint32_t reserved;
+    std::int64_t samplesPerPixel;
+    std::int64_t samplesPerPass;
+    std::int64_t completedPasses;
+    std::uint64_t seed;
+    std::uint64_t identity;
+};
+
+static_assert(sizeof(CheckpointHeader) == 72, "Checkpoint header layout changed!");
+
+// the checkpoint is written next to the old one and renamed over it, a render killed
+// while writing still finds the previous checkpoint
+inline void writeCheckpoint(const std::string& filename, Film& film, const RenderProgress& progress) {
+    CheckpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "PTC2", 4);
+    header.floatSize = sizeof(Float);
+    header.pixelBounds[0] = film.pixelBounds.pMin.x;
+    header.pixelBounds[1] = film.pixelBounds.pMin.y;
+    header.pixelBounds[2] = film.pixelBounds.pMax.x;
+    header.pixelBounds[3] = film.pixelBounds.pMax.y;
+    header.aovMask = film.getAOVLayout().enabled;
+    header.samplesPerPixel = progress.samplesPerPixel;
+    header.samplesPerPass = progress.samplesPerPass;
+    header.completedPasses = progress.completedPasses;
+    header.seed = progress.seed;
+    header.identity = progress.identity;
+
+    auto tempFilename = filename + ".tmp";
+    {
+        std::ofstream file(tempFilename, std::ios::binary);
+        if (!file) throw std::runtime_error("Unable to create file: " + tempFilename);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        film.writeState(file);
+        file.flush();
+        if (!file) throw std::runtime_error("Unable to write file: " + tempFilename);
+    }
+    if (std::rename(tempFilename.c_str(), filename.c_str()) != 0)
+        throw std::runtime_error("Unable to replace file: " + filename);
+}
+
+// returns false when there is no checkpoint yet, a checkpoint of another film or
+// another build's Float type is an error
+inline bool readCheckpoint(const std::string& filename, Film& film, RenderProgress& progress) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return false;
+
+    CheckpointHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, "PTC2", 4) != 0)
+        throw std::runtime_error("Not a checkpoint: " + filename);
+    if (header.floatSize != sizeof(Float))
+        throw std::runtime_error("Checkpoint was written with another Float type: " + filename);
+    if (header.pixelBounds[0] != film.pixelBounds.pMin.x || header.pixelBounds[1] != film.pixelBounds.pMin.y ||
+        header.pixelBounds[2] != film.pixelBounds.pMax.x || header.pixelBounds[3] != film.pixelBounds.pMax.y ||
+        header.aovMask != film.getAOVLayout().enabled)
+        throw std::runtime_error("Checkpoint does not match the film: " + filename);
+
+    film.readState(file);
+    progress.samplesPerPixel = header.samplesPerPixel;
+    progress.samplesPerPass = header.samplesPerPass;
+    progress.completedPasses = header.completedPasses;
+    progress.seed = header.seed;
+    progress.identity = header.identity;
+    return true;
+}
+
+// once the image of a finished render is written its checkpoint is no longer needed,
+// a checkpoint that does not exist is not an error
+inline void removeCheckpoint(const std::string& filename) {
+    std::remove(filename.c_str());
+    std::remove((filename + ".tmp").c_str());
+}
+
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef PT_CORE_DENOISER_H
+#define PT_CORE_DENOISER_H
+
+#include <pt/pt.h>
+#include <pt/math/vector2.h>
+#include <pt/math/vector3.h>
+
+namespace pt {
+
+// edge stopping parameters of the a-trous filter, larger sigmas blur more across edges
+struct DenoiserOptions {
+    int iterations = 5;                 // the footprint doubles every iteration
+    Float sigmaLuminance = 4;           // in standard deviations of the pixel's luminance
+    Float normalPower = 128;
+    Float sigmaDepth = (Float)0.05;     // relative depth change per pixel of tap distance
+    Float sigmaAlbedo = (Float)0.1;
+};
+
+// per pixel planes in scanline order, colors are filtered in place and variances is the
+// luminance variance of the pixel estimates, pixels without a hit have a zero normal
+struct DenoiserInput {
+    Vector2i resolution;
+    Vector3* colors;
+    const Float* variances;
+    const Vector3* albedos;
+    const Vector3* normals;
+    const Float* depths;
+};
+
+// edge avoiding a-trous wavelet filter guided by albedo, normal and depth, the color
+// is divided by albedo so that only the illumination is blurred, and the luminance
+// weight is scaled by the filtered variance as in spatiotemporal variance guided filtering
+void denoise(const DenoiserInput& input, const DenoiserOptions& options = DenoiserOptions());
+
+}
+
+#endif
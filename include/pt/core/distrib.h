@@ -11,7 +11,7 @@ namespace pt {
 
 class Distribution1D {
 public:
-    Distribution1D() noexcept;
+    Distribution1D() noexcept = default;
 
     Distribution1D(const Float* func, int n) noexcept : aliasIndex(n) {
         funcIntegral = std::accumulate(func, func + n, (Float)0);
@@ -28,7 +28,8 @@ public:
             else if (aliasPdf[i] > 1) high.push(i);
         }
 
-        while (!low.empty()) {
+        // rounding can leave entries slightly off 1 on either stack, they keep their own slot
+        while (!low.empty() && !high.empty()) {
             auto l = low.top(), h = high.top();
             low.pop();
             aliasIndex[l] = h;
@@ -39,6 +40,8 @@ public:
                 low.push(h);
             }
         }
+        for (; !low.empty(); low.pop()) aliasPdf[low.top()] = 1;
+        for (; !high.empty(); high.pop()) aliasPdf[high.top()] = 1;
     }
 
     int count() const {
@@ -75,7 +78,7 @@ public:
 
 private:
     friend class Distribution2D;
-    Float funcIntegral;
+    Float funcIntegral = 0;
     std::vector<Float> pdf;
     std::vector<Float> aliasPdf;
     std::vector<int> aliasIndex;
@@ -0,0 +1,69 @@
+#ifndef PT_CORE_DISTRIBUTED_H
+#define PT_CORE_DISTRIBUTED_H
+
+#include <cstdint>
+#include <cstring>
+#include <pt/core/film.h>
+
+namespace pt {
+
+// messages between the coordinator and its workers, sent as they are in memory, so every
+// process must run the same build on the same architecture, which the hello checks
+//
+//   worker                          coordinator
+//   WorkerHello            ->
+//                          <-       CoordinatorHello
+//                          <-       TileAssignment     (passSamples 0 when done)
+//   TileResult, tile state ->
+//   ...
+
+// describes the film a worker renders to, the coordinator drops workers whose film differs
+struct WorkerHello {
+    char magic[4];
+    std::uint32_t floatSize;
+    std::int32_t pixelBounds[4];
+    std::int32_t sampleBounds[4];
+    std::uint32_t aovMask;
+    std::uint32_t filterSampling;
+};
+
+// the worker's sampler takes the coordinator's seed, so that tiles get the same camera
+// samples and paths no matter which process renders them
+struct CoordinatorHello {
+    std::uint64_t seed;
+};
+
+struct TileAssignment {
+    std::int64_t pass;
+    std::int64_t passSamples;
+    std::int32_t tileX, tileY;
+};
+
+// followed by the FilmTile's raw state
+struct TileResult {
+    std::int64_t pass;
+    std::int32_t tileX, tileY;
+};
+
+inline WorkerHello makeWorkerHello(const Film& film) {
+    WorkerHello hello;
+    std::memset(&hello, 0, sizeof(hello));
+    std::memcpy(hello.magic, "PTWK", 4);
+    hello.floatSize = sizeof(Float);
+    auto sampleBounds = film.getSampleBounds();
+    hello.pixelBounds[0] = film.pixelBounds.pMin.x;
+    hello.pixelBounds[1] = film.pixelBounds.pMin.y;
+    hello.pixelBounds[2] = film.pixelBounds.pMax.x;
+    hello.pixelBounds[3] = film.pixelBounds.pMax.y;
+    hello.sampleBounds[0] = sampleBounds.pMin.x;
+    hello.sampleBounds[1] = sampleBounds.pMin.y;
+    hello.sampleBounds[2] = sampleBounds.pMax.x;
+    hello.sampleBounds[3] = sampleBounds.pMax.y;
+    hello.aovMask = film.getAOVLayout().enabled;
+    hello.filterSampling = film.filterSampling;
+    return hello;
+}
+
+}
+
+#endif
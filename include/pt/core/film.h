@@ -2,10 +2,24 @@
 #define PT_CORE_FILM_H
 
 #include <mutex>
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <algorithm>
 #include <memory>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+#include <pt/pt.h>
 #include <pt/math/vector3.h>
 #include <pt/math/bounds2.h>
+#include <pt/core/aov.h>
+#include <pt/core/stats.h>
+#include <pt/core/trace.h>
 #include <pt/core/filter.h>
+#include <pt/core/distrib.h>
+#include <pt/core/denoiser.h>
+#include <pt/core/parallel.h>
 #include <pt/utils/imageio.h>
 
 
@@ -17,20 +31,50 @@ struct Pixel {
     Float filterWeight;
 };
 
+// the buffers of a film tile, every thread of the pool keeps the ones of the last tile it
+// destroyed and its next tile takes them over instead of allocating, across frames too
+struct FilmTileBuffers {
+    std::vector<Pixel> pixels;
+    std::vector<Float> aovValues;
+};
+
+inline PerThread<FilmTileBuffers>& spareFilmTileBuffers() {
+    static PerThread<FilmTileBuffers> buffers;
+    return buffers;
+}
+
 class FilmTile {
 public:
-    FilmTile(const Bounds2i& pixelBounds, Float filterRadius,
-             const Float* filterTable, int filterTableWidth)
+    FilmTile(const Bounds2i& pixelBounds, const Bounds2i& sampleBounds, Float filterRadius,
+             const Float* filterTable, int filterTableWidth, const AOVLayout& aovLayout)
         : pixelBounds(pixelBounds)
+        , sampleBounds(sampleBounds)
         , filterTable(filterTable)
         , filterRadius(filterRadius)
         , invFilterRadius(1 / filterRadius)
-        , filterTableWidth(filterTableWidth) {
-            
-        pixels = std::unique_ptr<Pixel[]>(new Pixel[pixelBounds.area()]);
+        , filterTableWidth(filterTableWidth)
+        , aovLayout(aovLayout) {
+
+        if (auto spare = spareFilmTileBuffers().get()) {
+            pixels = std::move(spare->pixels);
+            aovValues = std::move(spare->aovValues);
+        }
+        pixels.assign(pixelBounds.area(), Pixel());
+        aovValues.assign(pixelBounds.area() * aovLayout.nValues, 0);
     }
 
-    void addSample(const Vector2f& pFilm, const Vector3& color) {
+    FilmTile(const FilmTile&) = delete;
+    FilmTile& operator=(const FilmTile&) = delete;
+
+    ~FilmTile() {
+        if (auto spare = spareFilmTileBuffers().get()) {
+            spare->pixels = std::move(pixels);
+            spare->aovValues = std::move(aovValues);
+        }
+    }
+
+    // AOVs are weighted by the same filter as the color
+    void addSample(const Vector2f& pFilm, const Vector3& color, const AOVSample* aovs = nullptr) {
         auto bounds = (Bounds2i)Bounds2f(
              ceil(pFilm - Vector2f(0.5) - Vector2f(filterRadius)),
             floor(pFilm + Vector2f(0.5) + Vector2f(filterRadius))
@@ -44,9 +88,18 @@ public:
                                 filterTable[std::min(offset.y, filterTableWidth - 1)];
             pixel.filterWeight += filterWeight;
             pixel.color += color * filterWeight;
+            if (aovs && !aovValues.empty()) aovLayout.add(getAOVValues(p), *aovs, filterWeight);
         }
     }
 
+    // a sample whose offset was drawn from the filter only contributes to its own pixel
+    void addSample(const Vector2i& pPixel, const Vector3& color, Float weight, const AOVSample* aovs = nullptr) {
+        auto& pixel = getPixel(pPixel);
+        pixel.filterWeight += weight;
+        pixel.color += color * weight;
+        if (aovs && !aovValues.empty()) aovLayout.add(getAOVValues(pPixel), *aovs, weight);
+    }
+
     Pixel& getPixel(const Vector2i& p) {
         auto width = pixelBounds.pMax.x - pixelBounds.pMin.x;
         auto offset = (p.x - pixelBounds.pMin.x) +
@@ -54,57 +107,218 @@ public:
         return pixels[offset];
     }
 
+    const Pixel& getPixel(const Vector2i& p) const {
+        return const_cast<FilmTile*>(this)->getPixel(p);
+    }
+
+    // the interleaved AOV values of a pixel, nullptr if the film has no AOVs
+    Float* getAOVValues(const Vector2i& p) {
+        if (aovValues.empty()) return nullptr;
+        auto width = pixelBounds.pMax.x - pixelBounds.pMin.x;
+        auto offset = (p.x - pixelBounds.pMin.x) +
+                      (p.y - pixelBounds.pMin.y) * width;
+        return &aovValues[offset * aovLayout.nValues];
+    }
+
+    const Float* getAOVValues(const Vector2i& p) const {
+        return const_cast<FilmTile*>(this)->getAOVValues(p);
+    }
+
     const Bounds2i& getPixelBounds() const {
         return pixelBounds;
     }
 
+    const Bounds2i& getSampleBounds() const {
+        return sampleBounds;
+    }
+
+    // the raw sums, tiles rendered by another process are sent this way
+    std::size_t getStateSize() const {
+        return sizeof(Pixel) * pixels.size() + sizeof(Float) * aovValues.size();
+    }
+
+    void writeState(std::ostream& out) const {
+        out.write(reinterpret_cast<const char*>(pixels.data()), sizeof(Pixel) * pixels.size());
+        out.write(reinterpret_cast<const char*>(aovValues.data()), sizeof(Float) * aovValues.size());
+    }
+
+    void readState(std::istream& in) {
+        in.read(reinterpret_cast<char*>(pixels.data()), sizeof(Pixel) * pixels.size());
+        in.read(reinterpret_cast<char*>(aovValues.data()), sizeof(Float) * aovValues.size());
+        if (!in) throw std::runtime_error("Film tile state is truncated!");
+    }
+
 private:
     const Bounds2i pixelBounds;
+    const Bounds2i sampleBounds;
     const Float* filterTable;
     Float filterRadius, invFilterRadius;
     int filterTableWidth;
-    std::unique_ptr<Pixel[]> pixels;
+    const AOVLayout& aovLayout;
+    std::vector<Pixel> pixels;
+    std::vector<Float> aovValues;
 };
 
 class Film {
 public:
-    Film(const Vector2i& resolution, const Bounds2f& cropWindow, std::unique_ptr<Filter>&& _filter)
+    // with filterSampling, camera sample offsets are importance sampled from the filter
+    // and every sample is added to a single pixel with weight 1 instead of being splatted
+    //
+    // a shard only takes the samples of its crop window but keeps every pixel they reach,
+    // the shards of a frame overlap by the filter radius and summing what writeShard wrote
+    // gives the frame, each sample having been taken by exactly one shard
+    Film(const Vector2i& resolution, const Bounds2f& cropWindow, std::unique_ptr<Filter>&& _filter,
+         bool filterSampling = false, bool shard = false)
         : resolution(resolution)
-        , pixelBounds(
-            Vector2i(std::ceil(resolution.x * cropWindow.pMin.x), std::ceil(resolution.y * cropWindow.pMin.y)),
-            Vector2i(std::ceil(resolution.x * cropWindow.pMax.x), std::ceil(resolution.y * cropWindow.pMax.y)))
-        , filter(std::move(_filter)) {
-            
-        pixels = std::unique_ptr<Pixel[]>(new Pixel[pixelBounds.area()]);
+        , pixelBounds(shard && !filterSampling
+            ? intersect(getReachedPixels(getShardSampleBounds(getCropBounds(resolution, cropWindow), resolution,
+                                                              _filter->radius), _filter->radius),
+                        Bounds2i(Vector2i(0, 0), resolution))
+            : getCropBounds(resolution, cropWindow))
+        , filterSampling(filterSampling)
+        , shard(shard)
+        , filter(std::move(_filter))
+        , shardBounds(getShardSampleBounds(getCropBounds(resolution, cropWindow), resolution,
+                                           filterSampling ? 0 : filter->radius)) {
+
+        rowLocks = std::unique_ptr<RowLock[]>(new RowLock[pixelBounds.diag().y]);
         for (auto i = 0; i < filterTableWidth; ++i)
             filterTable[i] = filter->evaluate((i + (Float)0.5) * filter->radius / filterTableWidth);
+
+        if (filterSampling) {
+            // the filter over [-radius, radius]^2 is tabulated from the separable filter
+            // table, negative lobes are sampled by magnitude and carry a negative weight
+            Float func[filterSampleWidth * filterSampleWidth];
+            for (auto y = 0; y < filterSampleWidth; ++y) {
+                for (auto x = 0; x < filterSampleWidth; ++x) {
+                    func[y * filterSampleWidth + x] = std::abs(
+                        filterTable[filterTableIndex(x)] * filterTable[filterTableIndex(y)]);
+                }
+            }
+            filterDistrib.reset(new Distribution2D(func, filterSampleWidth, filterSampleWidth));
+        }
+    }
+
+    // offset of a camera sample from the pixel center, distributed like the filter
+    Vector2f sampleFilter(const Vector2f& u, Float& weight) const {
+        Float pdf;
+        auto offset = filterDistrib->sampleContinuous(u, pdf) * (2 * filter->radius) - Vector2f(filter->radius);
+        auto cell = min((Vector2i)(floor((offset + Vector2f(filter->radius)) * filter->invRadius * (filterSampleWidth / 2))),
+                        Vector2i(filterSampleWidth - 1));
+        weight = filterTable[filterTableIndex(cell.x)] * filterTable[filterTableIndex(cell.y)] < 0 ? -1 : 1;
+        return offset;
     }
 
     Bounds2i getSampleBounds() const {
-        return (Bounds2i)Bounds2f(
-            floor((Vector2f)pixelBounds.pMin + Vector2f(0.5) - Vector2f(filter->radius)),
-             ceil((Vector2f)pixelBounds.pMax - Vector2f(0.5) + Vector2f(filter->radius))
-        );
+        return getSampleBounds(pixelBounds);
+    }
+
+    // samples that can contribute to the pixels inside bounds
+    Bounds2i getSampleBounds(const Bounds2i& bounds) const {
+        auto sampleBounds = filterSampling ? bounds : getReachingSamples(bounds, filter->radius);
+        return shard ? intersect(sampleBounds, shardBounds) : sampleBounds;
+    }
+
+    // samples of the whole frame, whatever the crop window
+    Bounds2i getFrameSampleBounds() const {
+        auto frame = Bounds2i(Vector2i(0, 0), resolution);
+        return filterSampling ? frame : getReachingSamples(frame, filter->radius);
+    }
+
+    // crop window of one of count shards, shards are bands of whole tile rows and their
+    // edges sit half a pixel above a row, so rounding can not move them
+    static Bounds2f getShardCropWindow(const Vector2i& resolution, int index, int count) {
+        auto tileRows = (resolution.y + TileSize - 1) / TileSize;
+        auto y0 = std::min(tileRows * index / count * TileSize, resolution.y);
+        auto y1 = std::min(tileRows * (index + 1) / count * TileSize, resolution.y);
+        return Bounds2f(Vector2f(0, std::max((y0 - (Float)0.5) / resolution.y, (Float)0)),
+                        Vector2f(1, std::max((y1 - (Float)0.5) / resolution.y, (Float)0)));
+    }
+
+    // instead of keeping every pixel until writeImage, pixels are accumulated per output
+    // tile and each tile is written to a tiled EXR file and freed as soon as all samples
+    // that reach it are merged, must be called before rendering
+    void streamImage(const std::string& filename) {
+        if (pixels) throw std::runtime_error("Film already holds merged pixels!");
+        if (writer) throw std::runtime_error("Film is already streamed!");
+
+        auto diag = pixelBounds.diag();
+        nOutputTiles = Vector2i((diag.x + OutputTileSize - 1) / OutputTileSize,
+                                (diag.y + OutputTileSize - 1) / OutputTileSize);
+        outputTiles.reset(new OutputTile[nOutputTiles.x * nOutputTiles.y]);
+        for (auto y = 0; y < nOutputTiles.y; ++y) {
+            for (auto x = 0; x < nOutputTiles.x; ++x) {
+                auto& outputTile = outputTiles[y * nOutputTiles.x + x];
+                outputTile.pendingSamples = getSampleBounds(getOutputTileBounds(Vector2i(x, y))).area();
+            }
+        }
+        std::vector<ImageLayer> layers;
+        for (auto aov = 0; aov < AOVCount; ++aov) {
+            if (aovLayout.offsets[aov] < 0) continue;
+            auto& info = getAOVInfo((AOV)aov);
+            layers.push_back(ImageLayer { info.name, info.channels, nullptr });
+        }
+        writer.reset(new TiledImageWriter(filename, pixelBounds, resolution, OutputTileSize, layers));
+    }
+
+    bool isStreamed() const {
+        return (bool)writer;
+    }
+
+    // adds a layer to the output, integrators fill the enabled AOVs of every camera
+    // sample, must be called before rendering
+    void enableAOV(AOV aov) {
+        if (pixels || writer) throw std::runtime_error("AOVs must be enabled before rendering!");
+        aovLayout.enable(aov);
+    }
+
+    // the features the denoiser is guided by
+    void enableDenoiserAOVs() {
+        for (auto aov : { AOVDepth, AOVNormal, AOVAlbedo, AOVMoment }) enableAOV(aov);
+    }
+
+    const AOVLayout& getAOVLayout() const {
+        return aovLayout;
     }
 
     std::unique_ptr<FilmTile> getFilmTile(const Bounds2i& sampleBounds) const {
-        auto bounds = (Bounds2i)Bounds2f(
-             ceil((Vector2f)sampleBounds.pMin - Vector2f(0.5) - Vector2f(filter->radius)),
-            floor((Vector2f)sampleBounds.pMax + Vector2f(0.5) + Vector2f(filter->radius))
-        );
+        // filter sampled tiles do not overlap their neighbours
+        if (filterSampling) {
+            return std::unique_ptr<FilmTile>(new FilmTile(
+                intersect(sampleBounds, pixelBounds), sampleBounds,
+                filter->radius, filterTable, filterTableWidth, aovLayout
+            ));
+        }
         return std::unique_ptr<FilmTile>(new FilmTile(
-            intersect(bounds, pixelBounds),
-            filter->radius, filterTable, filterTableWidth
+            intersect(getReachedPixels(sampleBounds, filter->radius), pixelBounds), sampleBounds,
+            filter->radius, filterTable, filterTableWidth, aovLayout
         ));
     }
 
+    // rows are locked one at a time, so tiles only wait for each other while they happen
+    // to merge the same row and the lock is held for a single row of the tile
     void mergeFilmTile(std::unique_ptr<FilmTile>&& tile) {
-        std::lock_guard<std::mutex> lock(mutex);
-        for (const auto& pixel : tile->getPixelBounds()) {
-            auto& tilePixel = tile->getPixel(pixel);
-            auto& filmPixel = getPixel(pixel);
-            filmPixel.color += tilePixel.color;
-            filmPixel.filterWeight += tilePixel.filterWeight;
+        if (writer) {
+            mergeStreamedTile(*tile);
+            return;
+        }
+
+        allocatePixels();
+        auto& bounds = tile->getPixelBounds();
+        auto width = bounds.pMax.x - bounds.pMin.x;
+        auto nAOVValues = width * aovLayout.nValues;
+        for (auto y = bounds.pMin.y; y < bounds.pMax.y; ++y) {
+            auto tilePixels = &tile->getPixel(Vector2i(bounds.pMin.x, y));
+            auto filmPixels = &getPixel(Vector2i(bounds.pMin.x, y));
+            auto tileAOVs = tile->getAOVValues(Vector2i(bounds.pMin.x, y));
+            auto filmAOVs = getAOVValues(Vector2i(bounds.pMin.x, y));
+            std::unique_lock<std::mutex> lock(rowLocks[y - pixelBounds.pMin.y].mutex, std::defer_lock);
+            lockTraced(lock, "film row");
+            for (auto x = 0; x < width; ++x) {
+                filmPixels[x].color += tilePixels[x].color;
+                filmPixels[x].filterWeight += tilePixels[x].filterWeight;
+            }
+            for (auto i = 0; i < nAOVValues; ++i) filmAOVs[i] += tileAOVs[i];
         }
     }
 
@@ -115,7 +329,77 @@ public:
         return pixels[offset];
     }
 
+    Float* getAOVValues(const Vector2i& p) {
+        auto width = pixelBounds.pMax.x - pixelBounds.pMin.x;
+        auto offset = (p.x - pixelBounds.pMin.x) +
+                      (p.y - pixelBounds.pMin.y) * width;
+        return &aovPixels[offset * aovLayout.nValues];
+    }
+
+    // the raw sums of the pixels and AOVs, checkpoints restore them so that rendering can
+    // continue adding samples
+    void writeState(std::ostream& out) {
+        if (writer) throw std::runtime_error("Streamed films have no state to save!");
+        allocatePixels();
+        out.write(reinterpret_cast<const char*>(pixels.get()), sizeof(Pixel) * pixelBounds.area());
+        out.write(reinterpret_cast<const char*>(aovPixels.get()), sizeof(Float) * pixelBounds.area() * aovLayout.nValues);
+    }
+
+    void readState(std::istream& in) {
+        if (writer) throw std::runtime_error("Streamed films have no state to restore!");
+        allocatePixels();
+        in.read(reinterpret_cast<char*>(pixels.get()), sizeof(Pixel) * pixelBounds.area());
+        in.read(reinterpret_cast<char*>(aovPixels.get()), sizeof(Float) * pixelBounds.area() * aovLayout.nValues);
+        if (!in) throw std::runtime_error("Film state is truncated!");
+    }
+
+    // filters the rendered colors in place, samplesPerPixel turns the spread of the
+    // samples into the variance of the pixel estimates
+    void denoise(std::int64_t samplesPerPixel, const DenoiserOptions& options = DenoiserOptions()) {
+        PhaseTimer timer(PhaseDenoise);
+        if (writer) throw std::runtime_error("Streamed films can not be denoised!");
+        for (auto aov : { AOVDepth, AOVNormal, AOVAlbedo, AOVMoment })
+            if (aovLayout.offsets[aov] < 0) throw std::runtime_error("Denoising needs the AOVs of enableDenoiserAOVs!");
+
+        allocatePixels();
+        auto count = pixelBounds.area();
+        std::vector<Vector3> colors(count), albedos(count), normals(count);
+        std::vector<Float> variances(count), depths(count);
+        for (auto i = 0; i < count; ++i) {
+            auto& pixel = pixels[i];
+            auto values = &aovPixels[i * aovLayout.nValues];
+            auto invWeight = pixel.filterWeight != 0 ? 1 / pixel.filterWeight : 0;
+            auto aovValue = [&](AOV aov) {
+                auto offset = aovLayout.offsets[aov];
+                return Vector3(values[offset], values[offset + 1], values[offset + 2]) * invWeight;
+            };
+            colors[i] = pixel.color * invWeight;
+            albedos[i] = aovValue(AOVAlbedo);
+            normals[i] = aovValue(AOVNormal);
+            depths[i] = values[aovLayout.offsets[AOVDepth]] * invWeight;
+            auto l = luminance(colors[i]);
+            auto moment = values[aovLayout.offsets[AOVMoment]] * invWeight;
+            variances[i] = std::max(moment - l * l, (Float)0) / (Float)std::max(samplesPerPixel, (std::int64_t)1);
+        }
+
+        DenoiserInput input;
+        input.resolution = pixelBounds.pMax - pixelBounds.pMin;
+        input.colors = colors.data();
+        input.variances = variances.data();
+        input.albedos = albedos.data();
+        input.normals = normals.data();
+        input.depths = depths.data();
+        pt::denoise(input, options);
+
+        for (auto i = 0; i < count; ++i) pixels[i].color = colors[i] * pixels[i].filterWeight;
+    }
+
+    // AOVs are written as layers next to the image, which needs an EXR file
     void writeImage(const std::string& filename) {
+        PhaseTimer timer(PhaseWrite);
+        TraceScope scope("write image", "output");
+        if (writer) throw std::runtime_error("Streamed films are written while rendering!");
+        allocatePixels();
         auto offset = 0;
         std::unique_ptr<Float[]> rgbs(new Float[3 * pixelBounds.area()]);
         for (auto p : pixelBounds) {
@@ -125,19 +409,217 @@ public:
             rgbs[offset++] = rgb.y;
             rgbs[offset++] = rgb.z;
         }
-        pt::writeImage(filename, &rgbs[0], pixelBounds, resolution);
+        std::vector<std::vector<Float>> buffers;
+        auto layers = resolveAOVs(pixels.get(), aovPixels.get(), pixelBounds.area(), buffers);
+        pt::writeImage(filename, &rgbs[0], layers, pixelBounds, resolution);
+    }
+
+    // unnormalized sums as float channels R, G, B, the filter weight W and the AOV sums as
+    // layers, the shards of a frame are summed and normalized by exrmerge
+    void writeShard(const std::string& filename) {
+        PhaseTimer timer(PhaseWrite);
+        TraceScope scope("write shard", "output");
+        if (writer) throw std::runtime_error("Streamed films are written while rendering!");
+        allocatePixels();
+        ChannelImage image;
+        image.channels = { "R", "G", "B", "W" };
+        for (auto aov = 0; aov < AOVCount; ++aov) {
+            if (aovLayout.offsets[aov] < 0) continue;
+            auto& info = getAOVInfo((AOV)aov);
+            for (auto& channel : info.channels) image.channels.push_back(std::string(info.name) + "." + channel);
+        }
+        image.bounds = pixelBounds;
+        image.totalResolution = resolution;
+
+        auto count = pixelBounds.area();
+        auto nChannels = image.channels.size();
+        image.values.resize(count * nChannels);
+        for (auto i = 0; i < count; ++i) {
+            auto values = &image.values[i * nChannels];
+            *values++ = pixels[i].color.x;
+            *values++ = pixels[i].color.y;
+            *values++ = pixels[i].color.z;
+            *values++ = pixels[i].filterWeight;
+            for (auto aov = 0; aov < AOVCount; ++aov) {
+                auto offset = aovLayout.offsets[aov];
+                if (offset < 0) continue;
+                auto nAOVChannels = (int)getAOVInfo((AOV)aov).channels.size();
+                for (auto c = 0; c < nAOVChannels; ++c) *values++ = aovPixels[i * aovLayout.nValues + offset + c];
+            }
+        }
+        writeChannelImage(filename, image);
     }
 
 public:
     const Vector2i resolution;
     const Bounds2i pixelBounds;
+    const bool filterSampling;
+    const bool shard;
 
 private:
-    std::mutex mutex;
+    // one lock per cache line, neighbouring rows are merged by different threads
+    struct alignas(CacheLineSize) RowLock {
+        std::mutex mutex;
+    };
+
+    // pixels of one output tile and the number of samples that still have to be merged
+    // before the tile can be written
+    struct OutputTile {
+        std::mutex mutex;
+        std::unique_ptr<Pixel[]> pixels;
+        std::unique_ptr<Float[]> aovValues;
+        std::int64_t pendingSamples = 0;
+    };
+
+    static constexpr int OutputTileSize = 64;
+
+    static Bounds2i getCropBounds(const Vector2i& resolution, const Bounds2f& cropWindow) {
+        return Bounds2i(
+            Vector2i(std::ceil(resolution.x * cropWindow.pMin.x), std::ceil(resolution.y * cropWindow.pMin.y)),
+            Vector2i(std::ceil(resolution.x * cropWindow.pMax.x), std::ceil(resolution.y * cropWindow.pMax.y)));
+    }
+
+    static Bounds2i getReachingSamples(const Bounds2i& bounds, Float radius) {
+        return (Bounds2i)Bounds2f(
+            floor((Vector2f)bounds.pMin + Vector2f(0.5) - Vector2f(radius)),
+             ceil((Vector2f)bounds.pMax - Vector2f(0.5) + Vector2f(radius))
+        );
+    }
+
+    // a shard takes the samples of its crop window, shards on the edge of the frame also
+    // take the samples outside of it that a single render would take
+    static Bounds2i getShardSampleBounds(const Bounds2i& cropBounds, const Vector2i& resolution, Float radius) {
+        auto frameSamples = getReachingSamples(Bounds2i(Vector2i(0, 0), resolution), radius);
+        auto bounds = cropBounds;
+        if (bounds.pMin.x == 0) bounds.pMin.x = frameSamples.pMin.x;
+        if (bounds.pMin.y == 0) bounds.pMin.y = frameSamples.pMin.y;
+        if (bounds.pMax.x == resolution.x) bounds.pMax.x = frameSamples.pMax.x;
+        if (bounds.pMax.y == resolution.y) bounds.pMax.y = frameSamples.pMax.y;
+        return bounds;
+    }
+
+    // pixels that the filter of a sample inside sampleBounds reaches
+    static Bounds2i getReachedPixels(const Bounds2i& sampleBounds, Float radius) {
+        return (Bounds2i)Bounds2f(
+             ceil((Vector2f)sampleBounds.pMin - Vector2f(0.5) - Vector2f(radius)),
+            floor((Vector2f)sampleBounds.pMax + Vector2f(0.5) + Vector2f(radius))
+        );
+    }
+
+    // the whole image is only allocated once it is needed, streamed films never allocate it
+    void allocatePixels() {
+        std::call_once(pixelsAllocated, [&]() {
+            pixels = std::unique_ptr<Pixel[]>(new Pixel[pixelBounds.area()]);
+            aovPixels = std::unique_ptr<Float[]>(new Float[pixelBounds.area() * aovLayout.nValues]());
+        });
+    }
+
+    Bounds2i getOutputTileBounds(const Vector2i& tile) const {
+        auto pMin = pixelBounds.pMin + tile * OutputTileSize;
+        return Bounds2i(pMin, min(pMin + Vector2i(OutputTileSize), pixelBounds.pMax));
+    }
+
+    void mergeStreamedTile(const FilmTile& tile) {
+        auto& bounds = tile.getPixelBounds();
+        auto& sampleBounds = tile.getSampleBounds();
+
+        // every output tile whose samples overlap the tile's samples, not only the ones its
+        // pixels overlap, a tile can be done with an output tile without writing to it
+        auto reach = Vector2i((int)std::ceil(filter->radius) + 1);
+        auto t0 = max(sampleBounds.pMin - reach - pixelBounds.pMin, Vector2i(0)) / OutputTileSize;
+        auto t1 = min((sampleBounds.pMax + reach - pixelBounds.pMin + Vector2i(OutputTileSize - 1)) / OutputTileSize,
+                      nOutputTiles);
+        for (auto y = t0.y; y < t1.y; ++y) {
+            for (auto x = t0.x; x < t1.x; ++x) {
+                auto outputBounds = getOutputTileBounds(Vector2i(x, y));
+                auto samples = intersect(getSampleBounds(outputBounds), sampleBounds);
+                if (samples.isDegenerate()) continue;
+
+                auto& outputTile = outputTiles[y * nOutputTiles.x + x];
+                std::unique_ptr<Pixel[]> finished;
+                std::unique_ptr<Float[]> finishedAOVs;
+                {
+                    std::unique_lock<std::mutex> lock(outputTile.mutex, std::defer_lock);
+                    lockTraced(lock, "output tile");
+                    if (!outputTile.pixels) {
+                        outputTile.pixels = std::unique_ptr<Pixel[]>(new Pixel[outputBounds.area()]);
+                        outputTile.aovValues = std::unique_ptr<Float[]>(new Float[outputBounds.area() * aovLayout.nValues]());
+                    }
+                    auto width = outputBounds.diag().x;
+                    for (auto p : intersect(bounds, outputBounds)) {
+                        auto& tilePixel = tile.getPixel(p);
+                        auto offset = (p.x - outputBounds.pMin.x) + (p.y - outputBounds.pMin.y) * width;
+                        auto& outputPixel = outputTile.pixels[offset];
+                        outputPixel.color += tilePixel.color;
+                        outputPixel.filterWeight += tilePixel.filterWeight;
+                        auto tileAOVs = tile.getAOVValues(p);
+                        for (auto i = 0; i < aovLayout.nValues; ++i)
+                            outputTile.aovValues[offset * aovLayout.nValues + i] += tileAOVs[i];
+                    }
+                    outputTile.pendingSamples -= samples.area();
+                    if (!outputTile.pendingSamples) {
+                        finished = std::move(outputTile.pixels);
+                        finishedAOVs = std::move(outputTile.aovValues);
+                    }
+                }
+                if (finished) writeOutputTile(outputBounds, finished.get(), finishedAOVs.get());
+            }
+        }
+    }
+
+    void writeOutputTile(const Bounds2i& bounds, const Pixel* tilePixels, const Float* tileAOVs) {
+        TraceScope scope("write output tile", "output");
+        std::unique_ptr<Float[]> rgbs(new Float[3 * bounds.area()]);
+        for (auto i = 0; i < bounds.area(); ++i) {
+            auto rgb = tilePixels[i].color / tilePixels[i].filterWeight;
+            rgbs[3 * i + 0] = rgb.x;
+            rgbs[3 * i + 1] = rgb.y;
+            rgbs[3 * i + 2] = rgb.z;
+        }
+        std::vector<std::vector<Float>> buffers;
+        writer->writeTile(bounds, &rgbs[0], resolveAOVs(tilePixels, tileAOVs, bounds.area(), buffers));
+    }
+
+    // one buffer of filter weighted averages per enabled AOV, the layers point into buffers
+    std::vector<ImageLayer> resolveAOVs(const Pixel* pixels, const Float* values, int count,
+                                        std::vector<std::vector<Float>>& buffers) const {
+        std::vector<ImageLayer> layers;
+        buffers.reserve(AOVCount);
+        for (auto aov = 0; aov < AOVCount; ++aov) {
+            auto offset = aovLayout.offsets[aov];
+            if (offset < 0) continue;
+            auto& info = getAOVInfo((AOV)aov);
+            auto nChannels = (int)info.channels.size();
+            buffers.emplace_back(count * nChannels);
+            auto& buffer = buffers.back();
+            for (auto i = 0; i < count; ++i)
+                for (auto c = 0; c < nChannels; ++c)
+                    buffer[i * nChannels + c] = values[i * aovLayout.nValues + offset + c] / pixels[i].filterWeight;
+            layers.push_back(ImageLayer { info.name, info.channels, buffer.data() });
+        }
+        return layers;
+    }
+
     std::unique_ptr<Filter> filter;
+    const Bounds2i shardBounds;
+    std::once_flag pixelsAllocated;
     std::unique_ptr<Pixel[]> pixels;
+    std::unique_ptr<Float[]> aovPixels;
+    AOVLayout aovLayout;
+    std::unique_ptr<RowLock[]> rowLocks;
+    std::unique_ptr<TiledImageWriter> writer;
+    std::unique_ptr<OutputTile[]> outputTiles;
+    Vector2i nOutputTiles;
     static constexpr int filterTableWidth = 16;
     Float filterTable[filterTableWidth];
+
+    // cells of the sampling table, mirrored onto the filter table entries
+    static constexpr int filterSampleWidth = 2 * filterTableWidth;
+    std::unique_ptr<Distribution2D> filterDistrib;
+
+    static int filterTableIndex(int cell) {
+        return cell < filterTableWidth ? filterTableWidth - 1 - cell : cell - filterTableWidth;
+    }
 };
 
 }
@@ -1,10 +1,24 @@
 #ifndef PT_CORE_INTEGRATOR_H
 #define PT_CORE_INTEGRATOR_H
 
+#include <deque>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+#include <pt/core/aov.h>
 #include <pt/core/scene.h>
+#include <pt/core/stats.h>
+#include <pt/core/trace.h>
 #include <pt/core/camera.h>
 #include <pt/core/sampler.h>
 #include <pt/core/parallel.h>
+#include <pt/core/tileorder.h>
 
 namespace pt {
 
@@ -16,47 +30,391 @@ public:
 
 class SamplerIntegrator : public Integrator {
 public:
-    SamplerIntegrator(Camera& camera, Sampler& sampler) noexcept
-        : camera(camera), sampler(sampler)
+    SamplerIntegrator(Camera& camera, Sampler& sampler, bool packetTracing = false) noexcept
+        : camera(camera), sampler(sampler), packetTracing(packetTracing)
     { }
 
-    virtual Vector3 li(const Ray& ray, const Scene& scene) const = 0;
+    // every sample of a path is drawn from sampler, the sampler of the quarter the camera ray
+    // belongs to, so a path does not depend on the thread or process tracing it
+    virtual Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler) const = 0;
 
-    void render(const Scene& scene) override {
+    // with packetTracing, camera rays are traced in packets and the integrator
+    // receives the first intersection instead of tracing the camera ray itself
+    virtual Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler, Interaction& isect,
+                       bool foundIntersection) const {
+        return li(ray, scene, sampler);
+    }
+
+    // called instead of the above when the film has AOVs, integrators override it to fill
+    // the AOVs they know about, the default fills the ones given by the first intersection
+    virtual Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler, Interaction& isect,
+                       bool foundIntersection, AOVSample& aovs) const {
+        aovs.setGeometry(ray, isect, foundIntersection);
+        return li(ray, scene, sampler, isect, foundIntersection);
+    }
+
+    // the order tiles are handed out in, groupSize consecutive tiles go to the same thread
+    // while there are enough tiles left for every thread
+    void setTileOrder(TileOrder order, int groupSize = 1) {
+        if (groupSize <= 0) throw std::runtime_error("A tile group needs at least one tile!");
+        tileOrder = order;
+        tileGroupSize = groupSize;
+    }
+
+    // by default the tiles of a frame are first sorted by the cost the pilot pass estimated,
+    // the tile order only applies among tiles of the same power of two cost, without the
+    // sort the tiles are handed out in the tile order alone
+    void setCostSorting(bool sort) {
+        sortTilesByCost = sort;
+    }
+
+    // renders in passes of samplesPerPass samples per pixel and saves the film after a pass
+    // once interval seconds went by since the last save, the last pass is always saved,
+    // a checkpoint that already exists is resumed by the next render
+    void enableCheckpoints(const std::string& filename, std::int64_t samplesPerPass, double interval) {
+        if (samplesPerPass <= 0) throw std::runtime_error("A pass needs at least one sample per pixel!");
+        checkpointFilename = filename;
+        this->samplesPerPass = samplesPerPass;
+        checkpointInterval = interval;
+    }
+
+    // a build with PT_TRAVERSAL_STATS writes the traversal cost heatmap of render to
+    // prefix.png and those of renderViews to prefix<view>.png, shards of a frame rendered
+    // at the same place need prefixes of their own
+    void setHeatmapPrefix(const std::string& prefix) {
+        heatmapPrefix = prefix;
+    }
+
+    // removes the checkpoint once the image of a finished render is written, until then the
+    // last checkpoint holds the finished film and a restart only has to write it again
+    void removeCheckpoint();
+
+    void render(const Scene& scene) override;
+
+    // renders every camera to its own film with the integrator's sampler, the tiles of all
+    // views go to one parallel loop, so threads done with the last tiles of a view start on
+    // the next one instead of waiting, checkpoints only cover render
+    void renderViews(const Scene& scene, const std::vector<Camera*>& cameras) {
+        if (cameras.empty()) return;
+        PhaseTimer timer(PhaseRender);
         parallelInit();
+#ifdef PT_TRAVERSAL_STATS
+        resetTraversalStats();
+#endif
 
-        auto sampleBounds = camera.film.getSampleBounds();
-        auto diag = sampleBounds.diag();
-        Vector2i nTiles((diag.x + TileSize - 1) / TileSize,
-                        (diag.y + TileSize - 1) / TileSize);
-
-        parallelFor2D([&](const Vector2i& tile) {
-            auto x0 = sampleBounds.pMin.x + TileSize * tile.x;
-            auto x1 = std::min(sampleBounds.pMax.x, x0 + TileSize);
-            auto y0 = sampleBounds.pMin.y + TileSize * tile.y;
-            auto y1 = std::min(sampleBounds.pMax.y, y0 + TileSize);
-            Bounds2i tileBounds(Vector2i(x0, y0), Vector2i(x1, y1));
-            auto filmTile = camera.film.getFilmTile(tileBounds);
-            auto seed = tile.y * nTiles.x + tile.x;
-            auto tileSampler = sampler.clone(seed);
-            for (auto p : tileBounds) {
-                Vector3 color(0);
-                tileSampler->startPixel();
-                do {
-                    auto cameraSample = tileSampler->getCameraSample(p);
-                    auto ray = camera.generateRay(cameraSample);
-                    filmTile->addSample(cameraSample.pFilm, li(ray, scene));
-                } while (tileSampler->startNextSample());
-            }
-            camera.film.mergeFilmTile(std::move(filmTile));
-        }, nTiles);
+        std::vector<TraversalHeatmap> heatmaps;
+        std::vector<std::vector<Vector2i>> tileOrders;
+        std::vector<std::int64_t> firstTiles;
+        std::int64_t nTiles = 0;
+        for (auto camera : cameras) {
+            heatmaps.emplace_back(camera->film.getSampleBounds());
+            tileOrders.push_back(getTileOrder(getTileCount(camera->film), tileOrder));
+            firstTiles.push_back(nTiles);
+            nTiles += (std::int64_t)tileOrders.back().size();
+        }
+
+        auto nViews = (std::int64_t)cameras.size();
+        auto samplesPerPass = getSamplesPerPass();
+        auto nPasses = (sampler.samplesPerPixel + samplesPerPass - 1) / samplesPerPass;
+        for (auto pass = (std::int64_t)0; pass < nPasses; ++pass) {
+            auto passSamples = std::min(samplesPerPass, sampler.samplesPerPixel - pass * samplesPerPass);
+            parallelFor1D([&](std::int64_t i) {
+                auto view = std::upper_bound(firstTiles.begin(), firstTiles.end(), i) - firstTiles.begin() - 1;
+                auto& camera = *cameras[view];
+                auto& tile = tileOrders[view][i - firstTiles[view]];
+                camera.film.mergeFilmTile(renderTile(scene, camera, pass, passSamples, tile, heatmaps[view], view, nViews));
+            }, nTiles, tileGroupSize);
+        }
 
+#ifdef PT_TRAVERSAL_STATS
+        reportTraversalStats(std::cout);
+        for (auto view = 0; view < nViews; ++view) {
+            auto& film = cameras[view]->film;
+            heatmaps[view].writeImage(heatmapPrefix + std::to_string(view) + ".png", film.pixelBounds, film.resolution);
+        }
+#endif
         parallelCleanup();
     }
 
+    // renders nothing itself, hands the tiles of every pass to the workers connecting to
+    // port and merges the tiles they send back, the tile of a worker that goes away is
+    // handed to another one, returns once every tile is merged
+    void renderCoordinator(std::uint16_t port);
+
+    // renders the tiles the coordinator at host:port assigns until it has none left, every
+    // hardware thread has a connection of its own, so threads and processes are balanced
+    // alike, retries for a while when the coordinator is not listening yet
+    void renderWorker(const Scene& scene, const std::string& host, std::uint16_t port);
+
 protected:
+    // tiles are the cells of one grid over the whole frame, starting at pixel 0 so that shard
+    // edges fall between tiles, the tiles on the edge of the frame also take the samples
+    // outside of it, a cropped film or a shard renders the frame's tiles clipped to its samples
+    static Vector2i getFrameTileCount(const Film& film) {
+        return max((film.resolution + Vector2i(TileSize - 1)) / TileSize, Vector2i(1));
+    }
+
+    static Bounds2i getFrameTileBounds(const Film& film, const Vector2i& frameTile) {
+        auto frameCount = getFrameTileCount(film);
+        auto frameSamples = film.getFrameSampleBounds();
+        auto pMin = frameTile * TileSize, pMax = pMin + Vector2i(TileSize);
+        if (frameTile.x == 0) pMin.x = frameSamples.pMin.x;
+        if (frameTile.y == 0) pMin.y = frameSamples.pMin.y;
+        if (frameTile.x == frameCount.x - 1) pMax.x = frameSamples.pMax.x;
+        if (frameTile.y == frameCount.y - 1) pMax.y = frameSamples.pMax.y;
+        return Bounds2i(pMin, pMax);
+    }
+
+    // the frame tiles the film's samples fall into
+    static Bounds2i getFrameTileRange(const Film& film) {
+        auto sampleBounds = film.getSampleBounds();
+        if (sampleBounds.isDegenerate()) return Bounds2i(Vector2i(0, 0), Vector2i(0, 0));
+        auto last = getFrameTileCount(film) - Vector2i(1);
+        auto tileOf = [](int p) { return p < 0 ? 0 : p / TileSize; };
+        return Bounds2i(
+            min(Vector2i(tileOf(sampleBounds.pMin.x), tileOf(sampleBounds.pMin.y)), last),
+            min(Vector2i(tileOf(sampleBounds.pMax.x - 1), tileOf(sampleBounds.pMax.y - 1)), last) + Vector2i(1)
+        );
+    }
+
+    static Vector2i getTileCount(const Film& film) {
+        return getFrameTileRange(film).diag();
+    }
+
+    static Bounds2i getTileBounds(const Film& film, const Vector2i& tile) {
+        auto frameTile = getFrameTileRange(film).pMin + tile;
+        return intersect(getFrameTileBounds(film, frameTile), film.getSampleBounds());
+    }
+
+    // settings of the integrator that change the image, hashed into checkpoints
+    virtual std::uint64_t getSettingsHash() const {
+        return 0;
+    }
+
+    // a hash of the integrator's type and settings, the scene's bounds and lights, and the
+    // rays of a grid of camera samples with what they hit, so that a change of the camera
+    // or of the geometry they reach does not resume a checkpoint of something else
+    std::uint64_t getCheckpointIdentity(const Scene& scene) const;
+
+    std::int64_t getSamplesPerPass() const {
+        return samplesPerPass > 0 ? samplesPerPass : std::max(sampler.samplesPerPixel, (std::int64_t)1);
+    }
+
+    // the seconds a few paths per tile take, the order of the first pass rendered
+    std::vector<double> estimateTileCosts(const Scene& scene) const {
+        auto nTiles = getTileCount(camera.film);
+        std::vector<double> costs((std::size_t)nTiles.x * nTiles.y);
+        // the estimate only sorts the tiles, without the sort no pilot paths are traced
+        if (!sortTilesByCost) return costs;
+        parallelFor1D([&](std::int64_t i) {
+            auto bounds = getTileBounds(camera.film, Vector2i((int)(i % nTiles.x), (int)(i / nTiles.x)));
+            auto diag = (Vector2f)bounds.diag();
+            // tile seeds count up from 0, pilot seeds have the top bit set, so they never meet
+            auto pilotSampler = acquireClone(sampler, PilotSeeds | (std::uint64_t)i);
+            auto start = std::chrono::steady_clock::now();
+            for (auto j = 0; j < PilotSamples; ++j) {
+                auto u = pilotSampler->get2D();
+                auto p = bounds.pMin + Vector2i((int)(u.x * diag.x), (int)(u.y * diag.y));
+                li(camera.generateRay(pilotSampler->getCameraSample(p, camera.film)), scene, *pilotSampler);
+            }
+            costs[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            addRenderCount(CameraRays, PilotSamples);
+            releaseClone(std::move(pilotSampler));
+        }, (std::int64_t)costs.size(), 16);
+        return costs;
+    }
+
+    // tiles start in order of their estimated cost, the most expensive first, once there are
+    // fewer tiles left than threads the next tile is split into its quarters, so the threads
+    // finish together instead of waiting for a few slow tiles at the end of the pass, returns
+    // the seconds each tile took, the estimate of the next pass
+    std::vector<double> renderPass(const Scene& scene, std::int64_t pass, std::int64_t passSamples,
+                                   const std::vector<double>& estimatedCosts, TraversalHeatmap& heatmap) {
+        auto nTiles = getTileCount(camera.film);
+
+        // costs are compared by their power of two, tiles of about the same cost keep the
+        // tile order, so that the tiles in flight stay close to each other
+        std::vector<int> order, costClasses(estimatedCosts.size());
+        for (auto& tile : getTileOrder(nTiles, tileOrder)) order.push_back(tile.y * nTiles.x + tile.x);
+        for (std::size_t i = 0; i < estimatedCosts.size(); ++i)
+            costClasses[i] = estimatedCosts[i] > 0 ? std::ilogb(estimatedCosts[i]) : std::numeric_limits<int>::min();
+        if (sortTilesByCost) {
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+                return costClasses[a] > costClasses[b];
+            });
+        }
+
+        // quarter -1 is the whole tile
+        struct Work {
+            int tile;
+            int quarter;
+        };
+        std::deque<Work> queue;
+        for (auto tile : order) queue.push_back(Work { tile, -1 });
+
+        std::vector<double> costs(estimatedCosts.size(), 0);
+        std::mutex mutex;
+        auto nThreads = parallelThreadCount();
+        parallelFor1D([&](std::int64_t) {
+            std::vector<Work> group;
+            while (true) {
+                group.clear();
+                {
+                    std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+                    lockTraced(lock, "tile queue");
+                    if (queue.empty()) return;
+                    auto work = queue.front();
+                    queue.pop_front();
+                    if (work.quarter < 0 && (int)queue.size() < nThreads) {
+                        for (auto quarter = 3; quarter > 0; --quarter)
+                            queue.push_front(Work { work.tile, quarter });
+                        work.quarter = 0;
+                    }
+                    group.push_back(work);
+                    while ((int)group.size() < tileGroupSize && (int)queue.size() > nThreads &&
+                           queue.front().quarter < 0) {
+                        group.push_back(queue.front());
+                        queue.pop_front();
+                    }
+                }
+
+                for (auto& work : group) {
+                    auto start = std::chrono::steady_clock::now();
+                    auto tile = Vector2i(work.tile % nTiles.x, work.tile / nTiles.x);
+                    camera.film.mergeFilmTile(work.quarter < 0
+                        ? renderTile(scene, camera, pass, passSamples, tile, heatmap)
+                        : renderQuarter(scene, camera, pass, passSamples, tile, work.quarter, heatmap));
+                    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    std::lock_guard<std::mutex> lock(mutex);
+                    costs[work.tile] += seconds;
+                }
+            }
+        }, nThreads);
+        return costs;
+    }
+
+    // a tile is rendered as its four quarters, which clone the sampler with seeds of their
+    // own and pass the clone to li, so a quarter's camera samples and the paths traced from
+    // them are the same whether its tile was split or not and whichever thread, process or
+    // shard renders it, only the order samples are summed in differs, the views of a batch
+    // take every nViews-th tile seed so that they do not share samples
+    std::unique_ptr<FilmTile> renderTile(const Scene& scene, const Camera& camera, std::int64_t pass,
+                                         std::int64_t passSamples, const Vector2i& tile, TraversalHeatmap& heatmap,
+                                         std::int64_t view = 0, std::int64_t nViews = 1) const {
+        TraceScope scope("tile", "render", "tile", tile.y * getTileCount(camera.film).x + tile.x);
+        auto filmTile = camera.film.getFilmTile(getTileBounds(camera.film, tile));
+        for (auto quarter = 0; quarter < 4; ++quarter)
+            addQuarterSamples(scene, camera, *filmTile, pass, passSamples, tile, quarter, heatmap, view, nViews);
+        return filmTile;
+    }
+
+    // a quarter of a tile in a film tile of its own, for splitting tiles between threads
+    std::unique_ptr<FilmTile> renderQuarter(const Scene& scene, const Camera& camera, std::int64_t pass,
+                                            std::int64_t passSamples, const Vector2i& tile, int quarter,
+                                            TraversalHeatmap& heatmap) const {
+        TraceScope scope("quarter", "render", "tile", tile.y * getTileCount(camera.film).x + tile.x);
+        auto filmTile = camera.film.getFilmTile(getQuarterBounds(camera.film, tile, quarter));
+        addQuarterSamples(scene, camera, *filmTile, pass, passSamples, tile, quarter, heatmap, 0, 1);
+        return filmTile;
+    }
+
+    // quarters are numbered in row-major order, the quarters of a tile at the edge of the
+    // film may be empty
+    static Bounds2i getQuarterBounds(const Film& film, const Vector2i& tile, int quarter) {
+        auto tileBounds = getTileBounds(film, tile);
+        auto center = min(tileBounds.pMin + Vector2i(TileSize / 2), tileBounds.pMax);
+        return Bounds2i(
+            Vector2i(quarter & 1 ? center.x : tileBounds.pMin.x, quarter & 2 ? center.y : tileBounds.pMin.y),
+            Vector2i(quarter & 1 ? tileBounds.pMax.x : center.x, quarter & 2 ? tileBounds.pMax.y : center.y)
+        );
+    }
+
+    void addQuarterSamples(const Scene& scene, const Camera& camera, FilmTile& filmTile, std::int64_t pass,
+                           std::int64_t passSamples, const Vector2i& tile, int quarter, TraversalHeatmap& heatmap,
+                           std::int64_t view, std::int64_t nViews) const {
+        auto bounds = getQuarterBounds(camera.film, tile, quarter);
+        if (bounds.isDegenerate()) return;
+        // seeded by the frame tile, so that a shard takes the samples a single render would
+        auto nTiles = getFrameTileCount(camera.film);
+        auto frameTile = getFrameTileRange(camera.film).pMin + tile;
+        auto seed = (((std::uint64_t)pass * nTiles.y + frameTile.y) * nTiles.x + frameTile.x) * nViews + view;
+        auto quarterSampler = acquireClone(sampler, seed * 4 + quarter);
+        quarterSampler->samplesPerPixel = passSamples;
+
+        auto aovMask = camera.film.getAOVLayout().enabled;
+        auto addSample = [&](const Vector2i& p, const CameraSample& cameraSample,
+                             const Vector3& color, AOVSample& aovs) {
+            if (aovs.wants(AOVMoment)) {
+                auto l = luminance(color);
+                aovs.set(AOVMoment, Vector3(l * l));
+            }
+            if (camera.film.filterSampling) filmTile.addSample(p, color, cameraSample.filterWeight, &aovs);
+            else filmTile.addSample(cameraSample.pFilm, color, &aovs);
+        };
+
+        RayPacket<PacketSize> packet;
+        CameraSample cameraSamples[PacketSize];
+        Vector2i pPixels[PacketSize];
+        auto tracePacket = [&]() {
+            Interaction isects[PacketSize];
+            auto cost = heatmap.threadCost();
+            scene.intersect(packet, isects);
+            auto packetCost = (heatmap.threadCost() - cost) / packet.count;
+            for (auto i = 0; i < packet.count; ++i) {
+                cost = heatmap.threadCost();
+                AOVSample aovs(aovMask);
+                auto color = aovMask ? li(packet.rays[i], scene, *quarterSampler, isects[i], packet.hit(i), aovs)
+                                     : li(packet.rays[i], scene, *quarterSampler, isects[i], packet.hit(i));
+                addSample(pPixels[i], cameraSamples[i], color, aovs);
+                heatmap.addSample(pPixels[i], packetCost + heatmap.threadCost() - cost);
+            }
+            packet.clear();
+        };
+
+        for (auto p : bounds) {
+            quarterSampler->startPixel();
+            do {
+                auto cameraSample = quarterSampler->getCameraSample(p, camera.film);
+                if (!packetTracing) {
+                    auto cost = heatmap.threadCost();
+                    auto ray = camera.generateRay(cameraSample);
+                    AOVSample aovs(aovMask);
+                    Vector3 color;
+                    if (aovMask) {
+                        // AOVs need the first intersection, so it is traced here
+                        Interaction isect;
+                        auto foundIntersection = scene.intersect(ray, isect);
+                        color = li(ray, scene, *quarterSampler, isect, foundIntersection, aovs);
+                    } else {
+                        color = li(ray, scene, *quarterSampler);
+                    }
+                    addSample(p, cameraSample, color, aovs);
+                    heatmap.addSample(p, heatmap.threadCost() - cost);
+                    continue;
+                }
+                cameraSamples[packet.count] = cameraSample;
+                pPixels[packet.count] = p;
+                packet.add(camera.generateRay(cameraSample));
+                if (packet.full()) tracePacket();
+            } while (quarterSampler->startNextSample());
+        }
+        if (packet.count) tracePacket();
+        addRenderCount(CameraRays, (std::uint64_t)bounds.area() * passSamples);
+        releaseClone(std::move(quarterSampler));
+    }
+
+    static constexpr std::uint64_t PilotSeeds = 1ull << 63;
+
     Camera& camera;
     Sampler& sampler;
+    bool packetTracing;
+    std::string checkpointFilename;
+    std::string heatmapPrefix = "./traversal";
+    std::int64_t samplesPerPass = 0;
+    double checkpointInterval = 0;
+    TileOrder tileOrder = TileOrder::Hilbert;
+    int tileGroupSize = 1;
+    bool sortTilesByCost = true;
 };
 
 }
@@ -52,6 +52,7 @@ public:
     Vector3 wo;
     BSDF* bsdf;
     const Primitive* primitive;
+    int primitiveId = -1;   // set by accelerators that number their primitives
 };
 
 }
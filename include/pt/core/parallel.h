@@ -1,15 +1,57 @@
 #ifndef PT_CORE_PARALLEL_H
 #define PT_CORE_PARALLEL_H
 
+#include <vector>
+#include <thread>
+#include <algorithm>
 #include <functional>
+#include <pt/pt.h>
 #include <pt/math/vector2.h>
 
 namespace pt {
 
+// init and cleanup calls nest, only the outermost pair starts and joins the worker threads
 void parallelInit();
 void parallelCleanup();
+// threads taking part in a parallel loop, the calling thread included
+int parallelThreadCount();
+// 0 for the thread that started the pool, 1 and up for its workers, -1 for other threads
+// and while the pool is not running, a worker keeps its index for the pool's lifetime
+int parallelThreadIndex();
 void parallelFor1D(std::function<void(int64_t)> func, int64_t count, int chunkSize = 1);
-void parallelFor2D(std::function<void(const Vector2i&)> func, const Vector2i& count);
+// cells are handed out along a Hilbert curve, chunkSize consecutive cells, neighbours on the
+// grid, go to the same thread
+void parallelFor2D(std::function<void(const Vector2i&)> func, const Vector2i& count, int chunkSize = 1);
+
+// a value for every thread of the pool, a thread only touches its own, so no locking is
+// needed, values outlive the threads and are taken up by the next pool's thread of the
+// same index, threads outside the pool get nullptr
+template <typename T>
+class PerThread {
+public:
+    PerThread()
+        : slots(std::max(std::thread::hardware_concurrency(), 1u))
+    { }
+
+    T* get() {
+        auto index = parallelThreadIndex();
+        return index < 0 ? nullptr : &slots[index].value;
+    }
+
+    // every thread's value, for reading or resetting them while no pool is running
+    template <typename F>
+    void forEach(F&& func) {
+        for (auto& slot : slots) func(slot.value);
+    }
+
+private:
+    // on a cache line of its own, threads writing their values do not share lines
+    struct alignas(CacheLineSize) Slot {
+        T value;
+    };
+
+    std::vector<Slot> slots;
+};
 
 }
 
@@ -2,6 +2,7 @@
 #define PT_CORE_PRIMITIVE_H
 
 #include <pt/core/shape.h>
+#include <pt/core/raypacket.h>
 #include <pt/core/material.h>
 #include <pt/lights/diffuse.h>
 
@@ -13,6 +14,15 @@ public:
     virtual Bounds3 worldBound() const = 0;
     virtual bool intersect(const Ray& ray, Interaction& isect) const = 0;
     virtual bool intersect(const Ray& ray) const = 0;
+
+    // sets bit i of packet.hitMask if packet.rays[i] hits, accelerators override this
+    // to traverse once for the whole packet
+    virtual void intersect(RayPacket<PacketSize>& packet, Interaction* isects) const {
+        for (auto i = 0; i < packet.count; ++i)
+            if (intersect(packet.rays[i], isects[i]))
+                packet.hitMask |= 1u << i;
+    }
+
     virtual const Material* getMaterial() const = 0;
     virtual const DiffuseAreaLight* getAreaLight() const = 0;
     virtual void computeScatteringFunctions(Interaction& isect) const = 0;
@@ -8,6 +8,9 @@ namespace pt {
 
 class Ray {
 public:
+    Ray() noexcept : tMax(Infinity)
+    { }
+
     Ray(const Vector3& o, const Vector3& d, Float tMax = Infinity) noexcept
         : o(o), d(d), tMax(tMax)
     { }
@@ -0,0 +1,88 @@
+#ifndef PT_CORE_RAYPACKET_H
+#define PT_CORE_RAYPACKET_H
+
+#include <cstdint>
+#include <pt/core/ray.h>
+#include <pt/math/bounds3.h>
+
+namespace pt {
+
+template <int N>
+class RayPacket {
+public:
+    static_assert(N <= 32, "RayPacket: hit mask holds at most 32 rays.");
+
+    void add(const Ray& ray) {
+        auto i = count++;
+        rays[i] = ray;
+        invDirs[i] = Vector3(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+        for (auto axis = 0; axis < 3; ++axis)
+            dirIsNeg[i][axis] = invDirs[i][axis] < 0;
+
+        if (i == 0) {
+            coherent = true;
+            originBounds = Bounds3(ray.o);
+            invDirBounds = Bounds3(invDirs[i]);
+        } else {
+            originBounds.expandBy(ray.o);
+            invDirBounds.expandBy(invDirs[i]);
+            for (auto axis = 0; axis < 3; ++axis)
+                coherent = coherent && dirIsNeg[i][axis] == dirIsNeg[0][axis];
+        }
+
+        for (auto axis = 0; axis < 3; ++axis)
+            coherent = coherent && std::isfinite(invDirs[i][axis]);
+    }
+
+    void clear() {
+        count = 0;
+        hitMask = 0;
+    }
+
+    bool full() const {
+        return count == N;
+    }
+
+    bool hit(int i) const {
+        return hitMask & (1u << i);
+    }
+
+    std::uint32_t activeMask() const {
+        return count == 32 ? ~0u : (1u << count) - 1;
+    }
+
+    // interval arithmetic over all origins and directions of a coherent packet,
+    // returns false only if no ray of the packet can hit the box
+    bool intersectInterval(const Bounds3& b) const {
+        auto tNear = (Float)0, tFar = Infinity;
+        for (auto axis = 0; axis < 3; ++axis) {
+            auto nearPlane = b[dirIsNeg[0][axis]][axis];
+            auto farPlane = b[1 - dirIsNeg[0][axis]][axis];
+            auto oMin = originBounds.pMin[axis], oMax = originBounds.pMax[axis];
+            auto iMin = invDirBounds.pMin[axis], iMax = invDirBounds.pMax[axis];
+            // (plane - o) * invDir is monotonic in o and in invDir, so the extremes lie at the corners
+            tNear = std::max(tNear, std::min(
+                std::min((nearPlane - oMin) * iMin, (nearPlane - oMin) * iMax),
+                std::min((nearPlane - oMax) * iMin, (nearPlane - oMax) * iMax)));
+            tFar = std::min(tFar, std::max(
+                std::max((farPlane - oMin) * iMin, (farPlane - oMin) * iMax),
+                std::max((farPlane - oMax) * iMin, (farPlane - oMax) * iMax)));
+        }
+        // the per ray test rounds differently, leave it a few ulps of room
+        return tNear <= tFar * (1 + 4 * std::numeric_limits<Float>::epsilon());
+    }
+
+public:
+    Ray rays[N];
+    Vector3 invDirs[N];
+    int dirIsNeg[N][3];
+    int count = 0;
+    std::uint32_t hitMask = 0;
+    bool coherent = false;
+    Bounds3 originBounds;
+    Bounds3 invDirBounds;
+};
+
+}
+
+#endif
@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <pt/math/vector2.h>
 #include <pt/core/camera.h>
+#include <pt/core/parallel.h>
 
 namespace pt {
 
@@ -12,11 +13,19 @@ class Sampler {
 public:
     virtual ~Sampler() = default;
 
-    explicit Sampler(std::int64_t samplesPerPixel) noexcept
-        : samplesPerPixel(samplesPerPixel)
+    Sampler(std::int64_t samplesPerPixel, std::uint64_t seed) noexcept
+        : samplesPerPixel(samplesPerPixel), seed(seed)
     { }
 
-    virtual std::unique_ptr<Sampler> clone(int seed) const = 0;
+    // clones with the same seed produce the same samples, so renders can be repeated
+    // and resumed
+    virtual std::unique_ptr<Sampler> clone(std::uint64_t seed) const = 0;
+
+    // turns this sampler into what parent.clone(seed) would return without allocating,
+    // false when it can not, for example when it is of another type than parent
+    virtual bool reclone(const Sampler& parent, std::uint64_t seed) {
+        return false;
+    }
 
     virtual Float get1D() = 0;
 
@@ -37,13 +46,43 @@ public:
         };
     }
 
+    // with filter sampling the offset from the pixel center follows the film's filter
+    CameraSample getCameraSample(const Vector2i& pRaster, const Film& film) {
+        if (!film.filterSampling) return getCameraSample(pRaster);
+        Float filterWeight;
+        auto offset = film.sampleFilter(get2D(), filterWeight);
+        return CameraSample {
+            (Vector2f)pRaster + Vector2f(0.5) + offset,
+            get2D(),
+            filterWeight
+        };
+    }
+
 public:
     std::int64_t samplesPerPixel;
+    std::uint64_t seed;
 
 protected:
     std::int64_t currentPixelSampleIndex;
 };
 
+// every thread of the pool keeps the clone it released last and reclones it for its next
+// tile, other threads allocate every clone
+inline PerThread<std::unique_ptr<Sampler>>& spareSamplers() {
+    static PerThread<std::unique_ptr<Sampler>> samplers;
+    return samplers;
+}
+
+inline std::unique_ptr<Sampler> acquireClone(const Sampler& sampler, std::uint64_t seed) {
+    auto spare = spareSamplers().get();
+    if (spare && *spare && (*spare)->reclone(sampler, seed)) return std::move(*spare);
+    return sampler.clone(seed);
+}
+
+inline void releaseClone(std::unique_ptr<Sampler>&& clone) {
+    if (auto spare = spareSamplers().get()) *spare = std::move(clone);
+}
+
 }
 
 #endif
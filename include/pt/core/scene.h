@@ -32,6 +32,10 @@ public:
         return accel.intersect(ray);
     }
 
+    void intersect(RayPacket<PacketSize>& packet, Interaction* isects) const {
+        accel.intersect(packet, isects);
+    }
+
 public:
     const Primitive& accel;
     std::vector<std::shared_ptr<Light>> lights;
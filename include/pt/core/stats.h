@@ -0,0 +1,168 @@
+#ifndef PT_CORE_STATS_H
+#define PT_CORE_STATS_H
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <ostream>
+#include <pt/math/bounds2.h>
+
+namespace pt {
+
+enum RayType {
+    ClosestRay,
+    ShadowRay,
+    RayTypeCount
+};
+
+// rays are binned by floor(log2(count + 1)), the last bucket takes everything above
+constexpr auto TraversalHistogramBuckets = 16;
+
+struct TraversalCounters {
+    std::uint64_t rays = 0;
+    std::uint64_t hits = 0;
+    std::uint64_t nodesVisited = 0;
+    std::uint64_t boxesTested = 0;
+    std::uint64_t primsTested = 0;
+    std::uint64_t maxNodesVisited = 0;
+    std::uint64_t maxPrimsTested = 0;
+    std::uint64_t nodesHistogram[TraversalHistogramBuckets] = {};
+    std::uint64_t primsHistogram[TraversalHistogramBuckets] = {};
+
+    void merge(const TraversalCounters& counters);
+};
+
+// counts the work done for a single ray, every method is an empty inline function
+// without PT_TRAVERSAL_STATS so the traversal loops compile to the same code
+struct RayStats {
+#ifdef PT_TRAVERSAL_STATS
+    int nodesVisited = 0;
+    int boxesTested = 0;
+    int primsTested = 0;
+
+    void testBox() { ++boxesTested; }
+    void visitNode() { ++nodesVisited; }
+    void testPrims(int n) { primsTested += n; }
+
+    // adds the ray to the counters of the calling thread
+    void record(RayType type, bool hit) const;
+#else
+    void testBox() { }
+    void visitNode() { }
+    void testPrims(int n) { }
+    void record(RayType type, bool hit) const { }
+#endif
+};
+
+// average traversal cost of the camera samples taken in each pixel, a sample's cost is the
+// cost recorded on the rendering thread while it is traced
+class TraversalHeatmap {
+public:
+#ifdef PT_TRAVERSAL_STATS
+    explicit TraversalHeatmap(const Bounds2i& sampleBounds);
+
+    std::uint64_t threadCost() const;
+
+    // samples of different tiles never share a pixel, no locking needed as long as a tile is
+    // only rendered once at a time, threads that may render the same tile of different
+    // passes at once need heatmaps of their own
+    void addSample(const Vector2i& p, std::uint64_t cost) {
+        auto offset = (p.x - sampleBounds.pMin.x) + (p.y - sampleBounds.pMin.y) * sampleBounds.diag().x;
+        costs[offset] += cost;
+        ++samples[offset];
+    }
+
+    // adds the costs of a heatmap over the same sample bounds
+    void merge(const TraversalHeatmap& heatmap);
+
+    // false colour from blue (no cost) to red (the most expensive pixel)
+    void writeImage(const std::string& filename, const Bounds2i& pixelBounds, const Vector2i& resolution) const;
+
+private:
+    Bounds2i sampleBounds;
+    std::vector<std::uint64_t> costs;
+    std::vector<std::uint32_t> samples;
+#else
+    explicit TraversalHeatmap(const Bounds2i& sampleBounds) { }
+    std::uint64_t threadCost() const { return 0; }
+    void addSample(const Vector2i& p, std::uint64_t cost) { }
+    void merge(const TraversalHeatmap& heatmap) { }
+#endif
+};
+
+// render statistics are always gathered, the counters of a thread are only written by that
+// thread, so counting is a plain increment, they are read once the threads are idle
+enum RenderCounter {
+    CameraRays,
+    // closest hit rays other than camera rays, path continuations and light sampling
+    IndirectRays,
+    ShadowRays,
+    Paths,
+    PathVertices,
+    RussianRouletteTerminations,
+    RenderCounterCount
+};
+
+enum RenderPhase {
+    PhaseLoad,
+    PhaseBuild,
+    PhaseRender,
+    PhaseDenoise,
+    PhaseWrite,
+    RenderPhaseCount
+};
+
+// the counters of the calling pool thread, nullptr outside the pool
+std::uint64_t* getThreadRenderCounters();
+// threads outside the pool, such as the connections of a distributed worker, share
+// atomic counters
+void addSharedRenderCount(RenderCounter counter, std::uint64_t n);
+
+inline void addRenderCount(RenderCounter counter, std::uint64_t n = 1) {
+    if (auto counters = getThreadRenderCounters()) counters[counter] += n;
+    else addSharedRenderCount(counter, n);
+}
+
+// adds the wall time from construction to destruction to a phase, phases running on several
+// threads at once add up
+class PhaseTimer {
+public:
+    explicit PhaseTimer(RenderPhase phase) noexcept
+        : phase(phase), start(std::chrono::steady_clock::now())
+    { }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    ~PhaseTimer();
+
+private:
+    RenderPhase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+void resetRenderStats();
+
+// phase times, rays by type, Mrays/s over the render phase, average path length, the paths
+// ended by Russian roulette and the peak resident set size
+void reportRenderStats(std::ostream& os);
+
+// the same as JSON, to compare throughput between versions
+void writeRenderStats(const std::string& filename);
+
+#ifdef PT_TRAVERSAL_STATS
+// nodes visited plus primitives tested by all rays recorded on the calling thread so far
+std::uint64_t threadTraversalCost();
+
+// merges the counters of every thread that recorded a ray
+TraversalCounters mergeTraversalStats(RayType type);
+
+void resetTraversalStats();
+
+void reportTraversalStats(std::ostream& os);
+#endif
+
+}
+
+#endif
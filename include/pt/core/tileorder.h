@@ -0,0 +1,69 @@
+#ifndef PT_CORE_TILEORDER_H
+#define PT_CORE_TILEORDER_H
+
+#include <vector>
+#include <cstdlib>
+#include <pt/math/vector2.h>
+
+namespace pt {
+
+// RowMajor hands out tiles the way they are stored, Hilbert follows a Hilbert curve over
+// the tile grid, consecutive tiles are neighbours, so the tiles in flight at once cover a
+// compact region and share what they bring into the cache
+enum class TileOrder { RowMajor, Hilbert };
+
+// generalized Hilbert curve over the rectangle spanned by a (major axis) and b from (x, y),
+// it covers rectangles of any size, all but a few steps on odd sized grids go to a neighbour
+inline void appendHilbertCurve(int x, int y, int ax, int ay, int bx, int by, std::vector<Vector2i>& curve) {
+    auto sign = [](int a) { return (a > 0) - (a < 0); };
+    auto floorHalf = [](int a) { return a >= 0 ? a / 2 : -((1 - a) / 2); };
+    auto w = std::abs(ax + ay), h = std::abs(bx + by);
+    auto dax = sign(ax), day = sign(ay);
+    auto dbx = sign(bx), dby = sign(by);
+
+    if (h == 1) {
+        for (auto i = 0; i < w; ++i, x += dax, y += day) curve.emplace_back(x, y);
+        return;
+    }
+    if (w == 1) {
+        for (auto i = 0; i < h; ++i, x += dbx, y += dby) curve.emplace_back(x, y);
+        return;
+    }
+
+    auto ax2 = floorHalf(ax), ay2 = floorHalf(ay);
+    auto bx2 = floorHalf(bx), by2 = floorHalf(by);
+    auto w2 = std::abs(ax2 + ay2), h2 = std::abs(bx2 + by2);
+    if (2 * w > 3 * h) {
+        // long rectangles are cut in two along the major axis
+        if ((w2 & 1) && w > 2) ax2 += dax, ay2 += day;
+        appendHilbertCurve(x, y, ax2, ay2, bx, by, curve);
+        appendHilbertCurve(x + ax2, y + ay2, ax - ax2, ay - ay2, bx, by, curve);
+    } else {
+        if ((h2 & 1) && h > 2) bx2 += dbx, by2 += dby;
+        appendHilbertCurve(x, y, bx2, by2, ax2, ay2, curve);
+        appendHilbertCurve(x + bx2, y + by2, ax, ay, bx - bx2, by - by2, curve);
+        appendHilbertCurve(x + (ax - dax) + (bx2 - dbx), y + (ay - day) + (by2 - dby),
+                           -bx2, -by2, -(ax - ax2), -(ay - ay2), curve);
+    }
+}
+
+// every tile of the grid once, in the given order
+inline std::vector<Vector2i> getTileOrder(const Vector2i& count, TileOrder order) {
+    std::vector<Vector2i> tiles;
+    if (count.x <= 0 || count.y <= 0) return tiles;
+    tiles.reserve((std::size_t)count.x * count.y);
+    if (order == TileOrder::RowMajor) {
+        for (auto y = 0; y < count.y; ++y)
+            for (auto x = 0; x < count.x; ++x)
+                tiles.emplace_back(x, y);
+    } else if (count.x >= count.y) {
+        appendHilbertCurve(0, 0, count.x, 0, 0, count.y, tiles);
+    } else {
+        appendHilbertCurve(0, 0, 0, count.y, count.x, 0, tiles);
+    }
+    return tiles;
+}
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef PT_CORE_TRACE_H
+#define PT_CORE_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+namespace pt {
+
+// events kept for every thread, once a thread's ring is full its oldest events are dropped
+constexpr auto TraceBufferEvents = 1 << 16;
+
+// a span of a thread's time, names, categories and argument names are string literals,
+// only their pointers are kept
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    const char* argName;
+    std::int64_t arg;
+    std::int64_t start;
+    std::int64_t duration;
+};
+
+extern std::atomic<bool> traceEnabled;
+
+inline bool isTracing() {
+    return traceEnabled.load(std::memory_order_relaxed);
+}
+
+// tracing is off until started, a scope only checks the flag then, starting drops the
+// events of an earlier trace, both are called while the traced threads are idle
+void startTrace();
+void stopTrace();
+
+// the events of every thread as Chrome trace event JSON, opened by chrome://tracing or
+// Perfetto, threads are named after their index in the pool
+void writeTrace(const std::string& filename);
+
+// nanoseconds since the trace started
+std::int64_t getTraceTime(std::chrono::steady_clock::time_point time);
+
+// adds a span from start to now to the calling thread's ring, no other thread writes to it,
+// so no locking is needed once the thread's ring exists
+void recordTraceEvent(const char* name, const char* category, std::int64_t start,
+                      const char* argName = nullptr, std::int64_t arg = 0);
+
+// traces the time from construction to destruction, a scope opened while tracing is off
+// records nothing
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* category, const char* argName = nullptr, std::int64_t arg = 0) noexcept
+        : name(name), category(category), argName(argName), arg(arg)
+        , tracing(isTracing()), start(tracing ? getTraceTime(std::chrono::steady_clock::now()) : 0)
+    { }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    ~TraceScope() {
+        if (tracing) recordTraceEvent(name, category, start, argName, arg);
+    }
+
+private:
+    const char* name;
+    const char* category;
+    const char* argName;
+    std::int64_t arg;
+    bool tracing;
+    std::int64_t start;
+};
+
+// locks a lock that is not held yet, while tracing the time spent waiting for another
+// thread to release it is traced as name, uncontended locks record nothing
+template <typename Lockable>
+void lockTraced(Lockable& lock, const char* name) {
+    if (!isTracing()) {
+        lock.lock();
+        return;
+    }
+    if (lock.try_lock()) return;
+    TraceScope scope(name, "lock");
+    lock.lock();
+}
+
+}
+
+#endif
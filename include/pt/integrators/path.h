@@ -8,7 +8,7 @@ namespace pt {
 class PathIntegrator : public SamplerIntegrator {
 public:
     PathIntegrator(int maxDepth, Camera& camera, Sampler& sampler) noexcept
-        : SamplerIntegrator(camera, sampler)
+        : SamplerIntegrator(camera, sampler, true)
         , maxDepth(maxDepth)
     { }
 
@@ -16,18 +16,30 @@ public:
         return (a * a) / (a * a + b * b);
     }
 
-    Vector3 li(const Ray& ray, const Scene& scene) const override;
+    std::uint64_t getSettingsHash() const override {
+        return (std::uint64_t)maxDepth;
+    }
+
+    Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler) const override;
+
+    Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler, Interaction& isect,
+               bool foundIntersection) const override;
+
+    // also fills albedo and the direct/indirect split
+    Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler, Interaction& isect,
+               bool foundIntersection, AOVSample& aovs) const override;
 
     Vector3 estimateDirect(
         const Interaction& isect,
         const Light& light,
-        const Scene& scene) const;
+        const Scene& scene,
+        Sampler& sampler) const;
 
-    Vector3 sampleOneLight(const Interaction& isect, const Scene& scene) const {
+    Vector3 sampleOneLight(const Interaction& isect, const Scene& scene, Sampler& sampler) const {
         auto nLights = scene.lights.size();
         if (!nLights) return Vector3(0);
         auto light = scene.lights[(std::size_t)(sampler.get1D() * nLights)];
-        return estimateDirect(isect, *light, scene) * nLights;
+        return estimateDirect(isect, *light, scene, sampler) * nLights;
     }
 
 public:
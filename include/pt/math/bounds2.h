@@ -53,6 +53,12 @@ Bounds2<T> intersect(const Bounds2<T>& a, const Bounds2<T>& b) {
     return Bounds2<T>(max(a.pMin, b.pMin), min(a.pMax, b.pMax));
 }
 
+// pMax is outside, as for the pixels of a film
+template <typename T>
+bool insideExclusive(const Vector2<T>& p, const Bounds2<T>& b) {
+    return p.x >= b.pMin.x && p.x < b.pMax.x && p.y >= b.pMin.y && p.y < b.pMax.y;
+}
+
 class Bounds2iIterator : public std::forward_iterator_tag {
 public:
     Bounds2iIterator(const Bounds2i& bounds, const Vector2i& p) noexcept
@@ -13,6 +13,9 @@ constexpr auto RayOriginOffsetEpsilon      = (Float)0.00001;
 constexpr auto ShadowEpsilon               = (Float)0.0001;
 constexpr auto TriangleIntersctEpsilon     = (Float)0.000001;
 constexpr auto TileSize                    = 16;
+constexpr auto PilotSamples                = 4;
+constexpr auto PacketSize                  = 16;
+constexpr auto CacheLineSize               = 64;
 
 }
 
@@ -8,15 +8,26 @@ namespace pt {
 
 class RandomSampler : public Sampler {
 public:
-    explicit RandomSampler(std::uint64_t samplesPerPixel) noexcept
-        : Sampler(samplesPerPixel)
-        , device()
-        , generator(device())
+    explicit RandomSampler(std::uint64_t samplesPerPixel, std::uint64_t seed = std::random_device()())
+        : Sampler(samplesPerPixel, seed)
+        , generator(seed)
         , distribution(0, 1)
     { }
 
-    std::unique_ptr<Sampler> clone(int seed) const override {
-        return std::unique_ptr<Sampler>(new RandomSampler(samplesPerPixel));
+    std::unique_ptr<Sampler> clone(std::uint64_t seed) const override {
+        return std::unique_ptr<Sampler>(new RandomSampler(samplesPerPixel, getCloneSeed(seed)));
+    }
+
+    // seeding the generator again starts the same sequence as a new one, but keeps its
+    // 2.5 KB of state where it is
+    bool reclone(const Sampler& parent, std::uint64_t seed) override {
+        auto randomParent = dynamic_cast<const RandomSampler*>(&parent);
+        if (!randomParent) return false;
+        samplesPerPixel = randomParent->samplesPerPixel;
+        this->seed = randomParent->getCloneSeed(seed);
+        generator.seed(this->seed);
+        distribution.reset();
+        return true;
     }
 
     Float get1D() override {
@@ -31,7 +42,14 @@ public:
     }
 
 private:
-    std::random_device device;
+    // the seeds of clones are hashed, so neighbouring tiles get unrelated sequences
+    std::uint64_t getCloneSeed(std::uint64_t seed) const {
+        auto z = this->seed + 0x9e3779b97f4a7c15ull * (seed + 1);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
     std::mt19937_64 generator;
     std::uniform_real_distribution<Float> distribution;
 };
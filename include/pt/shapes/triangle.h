@@ -4,6 +4,7 @@
 #include <vector>
 #include <pt/pt.h>
 #include <pt/core/shape.h>
+#include <pt/core/buffer.h>
 #include <pt/core/sampling.h>
 
 namespace pt {
@@ -20,29 +21,40 @@ public:
             , uvs(std::move(uvs))
     { }
 
-    Mesh(const Frame& frame, const Mesh& mesh) : indices(mesh.indices) {
-        vertices.reserve(mesh.vertices.size());
+    // buffers may borrow their memory, e.g. from a mapped .ptm file
+    Mesh(Buffer<int>&& indices,
+         Buffer<Vector3>&& vertices,
+         Buffer<Vector3>&& normals,
+         Buffer<Vector2f>&& uvs) noexcept
+            : indices(std::move(indices))
+            , vertices(std::move(vertices))
+            , normals(std::move(normals))
+            , uvs(std::move(uvs))
+    { }
+
+    Mesh(const Frame& frame, const Mesh& mesh) : indices(mesh.indices), uvs(mesh.uvs) {
+        std::vector<Vector3> worldVertices;
+        worldVertices.reserve(mesh.vertices.size());
         for (auto& p : mesh.vertices) {
-            vertices.push_back(frame.toWorldP(p));
+            worldVertices.push_back(frame.toWorldP(p));
         }
+        vertices = std::move(worldVertices);
 
         if (!mesh.normals.empty())  {
-            normals.reserve(mesh.normals.size());
+            std::vector<Vector3> worldNormals;
+            worldNormals.reserve(mesh.normals.size());
             for (auto& n : mesh.normals) {
-                normals.push_back(frame.toWorldN(n));
+                worldNormals.push_back(frame.toWorldN(n));
             }
-        }
-
-        if (!mesh.uvs.empty()) {
-            uvs = mesh.uvs;
+            normals = std::move(worldNormals);
         }
     }
 
 public:
-    std::vector<int> indices;
-    std::vector<Vector3> vertices;
-    std::vector<Vector3> normals;
-    std::vector<Vector2f> uvs;
+    Buffer<int> indices;
+    Buffer<Vector3> vertices;
+    Buffer<Vector3> normals;
+    Buffer<Vector2f> uvs;
 };
 
 class Triangle : public Shape {
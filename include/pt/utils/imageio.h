@@ -2,6 +2,7 @@
 #define PT_UTILS_IMAGEIO_H
 
 #include <string>
+#include <vector>
 #include <memory>
 #include <pt/math/bounds2.h>
 #include <pt/math/vector3.h>
@@ -14,6 +15,57 @@ void writeImage(
     const std::string& filename, const Float* rgbs,
     const Bounds2i& outputBounds, const Vector2i& totalResolution);
 
+// a named layer written next to the RGB channels, e.g. "N" with channels X, Y and Z is
+// stored as N.X, N.Y and N.Z, values holds channels.size() values per pixel
+struct ImageLayer {
+    std::string name;
+    std::vector<std::string> channels;
+    const Float* values;
+};
+
+// layers are only supported by EXR files
+void writeImage(
+    const std::string& filename, const Float* rgbs, const std::vector<ImageLayer>& layers,
+    const Bounds2i& outputBounds, const Vector2i& totalResolution);
+
+// float channels kept at full precision, such as the unnormalized sums of a film shard,
+// values holds channels.size() values per pixel of bounds, which is the data window
+// inside a display window of totalResolution
+struct ChannelImage {
+    std::vector<std::string> channels;
+    std::vector<Float> values;
+    Bounds2i bounds;
+    Vector2i totalResolution;
+};
+
+// only EXR files can hold arbitrary channels
+void writeChannelImage(const std::string& filename, const ChannelImage& image);
+
+// channels come back in the order the file stores them, EXR sorts them by name
+ChannelImage readChannelImage(const std::string& filename);
+
+// writes a tiled EXR file one tile at a time, tiles are on a grid of tileSize anchored at
+// outputBounds.pMin and can be written in any order from any thread, the file is complete
+// once every tile has been written
+class TiledImageWriter {
+public:
+    // only the names and channels of layers are used here
+    TiledImageWriter(
+        const std::string& filename, const Bounds2i& outputBounds, const Vector2i& totalResolution,
+        int tileSize, const std::vector<ImageLayer>& layers = std::vector<ImageLayer>());
+
+    ~TiledImageWriter();
+
+    // rgbs and the layer values hold the tile's pixels, bounds is the tile clipped to
+    // outputBounds, layers must match the ones the writer was created with
+    void writeTile(const Bounds2i& bounds, const Float* rgbs,
+                   const std::vector<ImageLayer>& layers = std::vector<ImageLayer>());
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
 }
 
 #endif
@@ -0,0 +1,69 @@
+#ifndef PT_UTILS_MAPPEDFILE_H
+#define PT_UTILS_MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace pt {
+
+// read only view of a whole file, pages are loaded on first access instead of being
+// copied through a stream buffer
+class MappedFile {
+public:
+    // sequential suits files that are parsed once front to back, files whose pages are
+    // read in place for a long time should not be hinted
+    MappedFile(const std::string& filename, bool sequential = true) {
+        auto fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1) throw std::runtime_error("Unable to open file: " + filename);
+
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            close(fd);
+            throw std::runtime_error("Unable to stat file: " + filename);
+        }
+
+        length = (std::size_t)st.st_size;
+        if (length) {
+            auto p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Unable to map file: " + filename);
+            }
+            bytes = static_cast<const char*>(p);
+            if (sequential) madvise(p, length, MADV_SEQUENTIAL);
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() noexcept {
+        if (bytes) munmap(const_cast<char*>(bytes), length);
+    }
+
+    const char* data() const {
+        return bytes;
+    }
+
+    const char* end() const {
+        return bytes + length;
+    }
+
+    std::size_t size() const {
+        return length;
+    }
+
+private:
+    const char* bytes = nullptr;
+    std::size_t length = 0;
+};
+
+}
+
+#endif
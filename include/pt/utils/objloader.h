@@ -1,48 +1,44 @@
 #ifndef PT_UTILS_OBJLOADER_H
 #define PT_UTILS_OBJLOADER_H
 
-#include <fstream>
-#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
 #include <iostream>
-#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <pt/core/stats.h>
+#include <pt/core/parallel.h>
 #include <pt/shapes/triangle.h>
+#include <pt/utils/parsing.h>
+#include <pt/utils/mappedfile.h>
 
 namespace pt {
 
-std::vector<std::string> tokenize(const std::string& string, const std::string& delim) {
-    std::vector<std::string> tokens;
-    std::string::size_type lastPos = 0, pos = string.find_first_of(delim, lastPos);
-
-    while (lastPos != std::string::npos) {
-        tokens.push_back(string.substr(lastPos, pos - lastPos));
-        lastPos = pos;
-        if (lastPos != std::string::npos) {
-            lastPos += 1;
-            pos = string.find_first_of(delim, lastPos);
-        }
-    }
-
-    return tokens;
-}
-
 class ObjVertex {
 public:
     ObjVertex() noexcept : p(0), n(0), uv(0)
     { }
 
-    ObjVertex(const std::string& string) {
-        auto tokens = tokenize(string, "/");
-
-        if (tokens.size() > 3)
+    // parses p, p/uv, p//n or p/uv/n
+    ObjVertex(const char*& str, const char* end) : ObjVertex() {
+        // relative (negative) indices are not supported
+        if (!parseInt(str, end, p) || p < 1)
             throw std::runtime_error("Invalid vertex data!");
 
-        p = std::atoi(tokens[0].c_str());
+        if (str < end && *str == '/') {
+            ++str;
+            parseInt(str, end, uv);
+            if (str < end && *str == '/') {
+                ++str;
+                if (!parseInt(str, end, n))
+                    throw std::runtime_error("Invalid vertex data!");
+            }
+        }
 
-        if (tokens.size() >= 2 && !tokens[1].empty())
-            uv = std::atoi(tokens[1].c_str());
-        
-        if (tokens.size() == 3 && !tokens[2].empty())
-            n = std::atoi(tokens[2].c_str());
+        if (str < end && !isSpace(*str) && *str != '\n')
+            throw std::runtime_error("Invalid vertex data!");
     }
 
     bool operator==(const ObjVertex& v) const {
@@ -57,80 +53,240 @@ public:
     int p, n, uv;
 };
 
-Mesh loadObjMesh(const std::string& filename) {
-    std::ifstream stream(filename);
+// open addressing with linear probing, OBJ indices start at 1 so p == 0 marks an empty slot
+class ObjVertexMap {
+public:
+    explicit ObjVertexMap(std::size_t expectedSize) {
+        std::size_t capacity = 16;
+        while (capacity < expectedSize * 2) capacity *= 2;
+        slots.resize(capacity);
+    }
 
-    if (stream.fail()) {
-        throw std::runtime_error("Unable to open OBJ file!");
+    // returns the index stored for v and whether v was added with the given index
+    std::pair<int, bool> insert(const ObjVertex& v, int index) {
+        if ((count + 1) * 4 > slots.size() * 3) grow();
+        auto mask = slots.size() - 1;
+        for (auto i = hash(v) & mask; ; i = (i + 1) & mask) {
+            auto& slot = slots[i];
+            if (slot.vertex == v) return { slot.index, false };
+            if (!slot.vertex.p) {
+                slot = { v, index };
+                ++count;
+                return { index, true };
+            }
+        }
     }
 
-    std::cout << "Loading \"" << filename << "\" ... " << std::endl;
+private:
+    // keys that agree in all but the lowest three bits of each index land in the same run of
+    // eight slots, vertices referenced close together in the file stay close in the table
+    static std::size_t hash(const ObjVertex& v) {
+        auto h = (std::uint64_t)(std::uint32_t)(v.p >> 3) * 0x9E3779B97F4A7C15ull;
+        h ^= ((std::uint64_t)(std::uint32_t)(v.uv >> 3) << 32 | (std::uint32_t)(v.n >> 3)) * 0xC2B2AE3D27D4EB4Full;
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+        return (std::size_t)((h ^ (h >> 31)) << 3 | (v.p & 7));
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        count = 0;
+        for (auto& slot : old)
+            if (slot.vertex.p) insert(slot.vertex, slot.index);
+    }
 
+    struct Slot {
+        ObjVertex vertex;
+        int index = 0;
+    };
+
+    std::vector<Slot> slots;
+    std::size_t count = 0;
+};
+
+// everything parsed from one line aligned piece of the file, face vertices are welded
+// within the chunk and still refer to the file's global 1-based indices, so chunks
+// can be parsed independently
+struct ObjChunk {
     std::vector<Vector3> positions;
     std::vector<Vector3> normals;
     std::vector<Vector2f> uvs;
-    std::vector<int> indices;
-    std::vector<ObjVertex> vertices;
+    std::vector<ObjVertex> vertices;    // distinct face vertices in order of first appearance
+    std::vector<int> indices;           // three per triangle, into vertices
+    std::string error;
+};
+
+constexpr std::size_t ObjChunkBytes = 1 << 22;
+
+// only used to size the vertex map, so faces are counted as lines starting with "f" and
+// the scan stays a single branch free loop over the bytes
+inline std::size_t countObjFaces(const char* str, const char* end) {
+    std::size_t nFaces = 0;
+    if (end - str > 1) nFaces += str[0] == 'f' && isSpace(str[1]);
+    for (; end - str > 1; ++str)
+        nFaces += (str[0] == '\n') & (str[1] == 'f');
+    return nFaces;
+}
 
-    auto hash = [](const ObjVertex& v) {
-        auto hash = std::hash<int>()(v.p);
-        hash = hash * 37 + std::hash<int>()(v.uv);
-        hash = hash * 37 + std::hash<int>()(v.n);
-        return hash;
+inline void parseObjChunk(const char* str, const char* end, ObjChunk& chunk) {
+    std::vector<ObjVertex> polygon;
+
+    // a closed triangle mesh has about half as many vertices as faces
+    auto nFaces = countObjFaces(str, end);
+    ObjVertexMap map(nFaces / 2);
+    chunk.indices.reserve(nFaces * 3);
+
+    auto addVertex = [&](const ObjVertex& v) {
+        auto [index, inserted] = map.insert(v, (int)chunk.vertices.size());
+        if (inserted) chunk.vertices.push_back(v);
+        chunk.indices.push_back(index);
     };
 
-    std::string lineStr;
-    std::unordered_map<ObjVertex, int, decltype(hash)> map(200, hash);
+    auto parseVector3 = [](const char*& str, const char* end) {
+        Vector3 v;
+        for (auto i = 0; i < 3; ++i) {
+            skipSpaces(str, end);
+            if (!parseFloat(str, end, v[i]))
+                throw std::runtime_error("Invalid OBJ vector data!");
+        }
+        return v;
+    };
 
-    while (std::getline(stream, lineStr)) {
-        std::istringstream line(lineStr);
-        std::string prefix;
-        line >> prefix;
+    while (str < end) {
+        auto lineEnd = nextLine(str, end);
+        skipSpaces(str, lineEnd);
 
-        if (prefix == "v") {
-            Vector3 p;
-            line >> p.x >> p.y >> p.z;
+        if (lineEnd - str > 2 && str[0] == 'v' && isSpace(str[1])) {
+            str += 2;
+            auto p = parseVector3(str, lineEnd);
             p.z = -p.z;
-            positions.push_back(p);
-        } else if (prefix == "vt") {
-            Vector2f uv;
-            line >> uv.x >> uv.y;
-            uvs.push_back(uv);
-        } else if (prefix == "vn") {
-            Vector3 n;
-            line >> n.x >> n.y >> n.z;
+            chunk.positions.push_back(p);
+        } else if (lineEnd - str > 3 && str[0] == 'v' && str[1] == 't' && isSpace(str[2])) {
+            str += 3;
+            Vector2f uv(0);
+            skipSpaces(str, lineEnd);
+            if (!parseFloat(str, lineEnd, uv.x)) throw std::runtime_error("Invalid OBJ uv data!");
+            // v and w are optional, 1D texture coordinates have v = 0, w is ignored
+            skipSpaces(str, lineEnd);
+            parseFloat(str, lineEnd, uv.y);
+            chunk.uvs.push_back(uv);
+        } else if (lineEnd - str > 3 && str[0] == 'v' && str[1] == 'n' && isSpace(str[2])) {
+            str += 3;
+            auto n = parseVector3(str, lineEnd);
             n.z = -n.z;
-            normals.push_back(n);
-        } else if (prefix == "f") {
-            std::string v1, v2, v3, v4;
-            line >> v1 >> v2 >> v3 >> v4;
-            ObjVertex verts[6];
-            int nVertices = 3;
-
-            verts[0] = ObjVertex(v1);
-            verts[1] = ObjVertex(v2);
-            verts[2] = ObjVertex(v3);
-
-            if (!v4.empty()) {
-                verts[3] = ObjVertex(v4);
-                verts[4] = verts[0];
-                verts[5] = verts[2];
-                nVertices = 6;
+            chunk.normals.push_back(n);
+        } else if (lineEnd - str > 2 && str[0] == 'f' && isSpace(str[1])) {
+            str += 2;
+            polygon.clear();
+            for (skipSpaces(str, lineEnd); str < lineEnd && *str != '\n'; skipSpaces(str, lineEnd))
+                polygon.emplace_back(str, lineEnd);
+            if (polygon.size() < 3)
+                throw std::runtime_error("Invalid OBJ face data!");
+
+            // polygons are split into a triangle fan
+            for (std::size_t i = 2; i < polygon.size(); ++i) {
+                addVertex(polygon[0]);
+                addVertex(polygon[i - 1]);
+                addVertex(polygon[i]);
             }
+        }
+
+        str = lineEnd;
+    }
+}
+
+inline Mesh loadObjMesh(const std::string& filename) {
+    PhaseTimer timer(PhaseLoad);
+    MappedFile file(filename);
+
+    std::cout << "Loading \"" << filename << "\" ... " << std::endl;
+
+    // chunk boundaries are moved forward to the next line start
+    auto nChunks = std::max<std::size_t>(file.size() / ObjChunkBytes, 1);
+    std::vector<const char*> chunkStarts(nChunks + 1, file.end());
+    chunkStarts[0] = file.data();
+    for (std::size_t i = 1; i < nChunks; ++i)
+        chunkStarts[i] = nextLine(file.data() + file.size() / nChunks * i - 1, file.end());
 
-            for (auto i = 0; i < nVertices; ++i) {
-                auto& v = verts[i];
-                auto it = map.find(v);
-                if (it == map.end()) {
-                    map[v] = vertices.size();
-                    indices.push_back(vertices.size());
-                    vertices.push_back(v);
-                } else {
-                    indices.push_back(it->second);
+    parallelInit();
+
+    std::vector<ObjChunk> chunks(nChunks);
+    parallelFor1D([&](int64_t i) {
+        // exceptions can't leave a worker thread
+        try {
+            parseObjChunk(chunkStarts[i], chunkStarts[i + 1], chunks[i]);
+        } catch (const std::exception& e) {
+            chunks[i].error = e.what();
+        }
+    }, nChunks);
+
+    std::vector<Vector3> positions;
+    std::vector<Vector3> normals;
+    std::vector<Vector2f> uvs;
+    std::size_t nPositions = 0, nNormals = 0, nUvs = 0, nChunkVertices = 0;
+    std::vector<std::size_t> indexOffsets(nChunks + 1, 0);
+    for (std::size_t i = 0; i < nChunks; ++i) {
+        auto& chunk = chunks[i];
+        if (!chunk.error.empty()) {
+            parallelCleanup();
+            throw std::runtime_error(chunk.error);
+        }
+        nPositions += chunk.positions.size();
+        nNormals += chunk.normals.size();
+        nUvs += chunk.uvs.size();
+        nChunkVertices += chunk.vertices.size();
+        indexOffsets[i + 1] = indexOffsets[i] + chunk.indices.size();
+    }
+    positions.reserve(nPositions);
+    normals.reserve(nNormals);
+    uvs.reserve(nUvs);
+    for (auto& chunk : chunks) {
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+        chunk.positions = std::vector<Vector3>();
+        chunk.normals = std::vector<Vector3>();
+        chunk.uvs = std::vector<Vector2f>();
+    }
+
+    // only vertices shared across chunk boundaries are welded here, walking the chunks in
+    // order keeps the vertices in order of first appearance in the file
+    std::vector<ObjVertex> vertices;
+    std::vector<std::vector<int>> remaps(nChunks);
+    auto map = std::make_unique<ObjVertexMap>(nChunkVertices);
+    for (std::size_t i = 0; i < nChunks; ++i) {
+        auto& remap = remaps[i];
+        remap.reserve(chunks[i].vertices.size());
+        for (auto& v : chunks[i].vertices) {
+            auto [index, inserted] = map->insert(v, (int)vertices.size());
+            if (inserted) {
+                if (v.p > (int)positions.size() ||
+                    (!normals.empty() && (v.n < 1 || v.n > (int)normals.size())) ||
+                    (!uvs.empty() && (v.uv < 1 || v.uv > (int)uvs.size()))) {
+                    parallelCleanup();
+                    throw std::runtime_error("OBJ face index out of range!");
                 }
+                vertices.push_back(v);
             }
+            remap.push_back(index);
         }
+        chunks[i].vertices = std::vector<ObjVertex>();
     }
+    map.reset();
+
+    std::vector<int> indices(indexOffsets[nChunks]);
+    parallelFor1D([&](int64_t i) {
+        auto& chunk = chunks[i];
+        auto& remap = remaps[i];
+        auto offset = indexOffsets[i];
+        for (std::size_t j = 0; j < chunk.indices.size(); ++j)
+            indices[offset + j] = remap[chunk.indices[j]];
+        chunk.indices = std::vector<int>();
+        remap = std::vector<int>();
+    }, nChunks);
+
+    parallelCleanup();
 
     std::vector<Vector3> meshVertices;
     meshVertices.reserve(vertices.size());
@@ -0,0 +1,135 @@
+#ifndef PT_UTILS_PARSING_H
+#define PT_UTILS_PARSING_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+namespace pt {
+
+// number parsers over [p, end) that advance p past what they consumed, the text does
+// not need to be null terminated so they can run directly on a mapped file
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// newlines are not spaces, lines are split before parsing
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline void skipSpaces(const char*& p, const char* end) {
+    while (p < end && isSpace(*p)) ++p;
+}
+
+inline const char* nextLine(const char* p, const char* end) {
+    auto newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return newline ? newline + 1 : end;
+}
+
+// nothing but spaces up to the line end, \r\n line endings included
+inline bool isBlankLine(const char* p, const char* lineEnd) {
+    skipSpaces(p, lineEnd);
+    return p == lineEnd || *p == '\n';
+}
+
+template <typename T>
+bool parseInt(const char*& p, const char* end, T& value) {
+    auto q = p;
+    auto negative = false;
+    if (q < end && (*q == '-' || *q == '+')) negative = *q++ == '-';
+    if (q == end || !isDigit(*q)) return false;
+
+    std::int64_t v = 0;
+    while (q < end && isDigit(*q)) v = v * 10 + (*q++ - '0');
+    value = (T)(negative ? -v : v);
+    p = q;
+    return true;
+}
+
+// the text is copied to a null terminated buffer so that strtod stops at end, numbers
+// longer than the buffer are cut off
+template <typename T>
+bool parseFloatStrtod(const char*& p, const char* end, T& value) {
+    char buffer[512];
+    auto length = std::min<std::ptrdiff_t>(end - p, sizeof(buffer) - 1);
+    std::memcpy(buffer, p, length);
+    buffer[length] = '\0';
+    char* last;
+    auto v = std::strtod(buffer, &last);
+    if (last == buffer) return false;
+    value = (T)v;
+    p += last - buffer;
+    return true;
+}
+
+// decimal mantissa and exponent are gathered as integers and combined with a single
+// multiplication or division, which is exact while the mantissa fits the 53 bits of a
+// double and the power of ten is at most 1e22, longer mantissas, larger exponents, inf
+// and nan fall back to strtod, so doubles are correctly rounded, a float is rounded once
+// more from the double
+template <typename T>
+bool parseFloat(const char*& p, const char* end, T& value) {
+    static constexpr double powersOf10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    auto q = p;
+    auto negative = false;
+    if (q < end && (*q == '-' || *q == '+')) negative = *q++ == '-';
+
+    std::uint64_t mantissa = 0;
+    auto nDigits = 0, exponent = 0;
+    auto anyDigits = false, truncated = false;
+    for (; q < end && isDigit(*q); ++q, anyDigits = true) {
+        if (nDigits < 19) {
+            mantissa = mantissa * 10 + (*q - '0');
+            nDigits += mantissa != 0;
+        } else {
+            ++exponent;
+            truncated = true;
+        }
+    }
+    if (q < end && *q == '.') {
+        for (++q; q < end && isDigit(*q); ++q, anyDigits = true) {
+            if (nDigits < 19) {
+                mantissa = mantissa * 10 + (*q - '0');
+                nDigits += mantissa != 0;
+                --exponent;
+            } else {
+                truncated = true;
+            }
+        }
+    }
+
+    if (!anyDigits) return parseFloatStrtod(p, end, value);
+
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        auto e = q + 1;
+        int exp;
+        if (parseInt(e, end, exp)) {
+            exponent += exp;
+            q = e;
+        }
+    }
+
+    if (truncated || mantissa > (std::uint64_t(1) << 53) || exponent < -22 || exponent > 22) {
+        auto start = p;
+        if (!parseFloatStrtod(start, q, value)) return false;
+        p = q;
+        return true;
+    }
+
+    auto v = (double)mantissa;
+    if (exponent < 0) v /= powersOf10[-exponent];
+    else if (exponent > 0) v *= powersOf10[exponent];
+    value = (T)(negative ? -v : v);
+    p = q;
+    return true;
+}
+}
+
+#endif
@@ -3,10 +3,22 @@
 
 #include <map>
 #include <vector>
+#include <algorithm>
 #include <memory>
+#include <cstring>
+#include <cstdint>
 #include <sstream>
 #include <fstream>
+#include <pt/core/stats.h>
+#include <pt/core/parallel.h>
 #include <pt/shapes/triangle.h>
+#include <pt/utils/parsing.h>
+#include <pt/utils/mappedfile.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace pt {
 
@@ -34,6 +46,136 @@ template<> std::string typeName<uint32_t>()       { return "uint";    }
 template<> std::string typeName<float>()          { return "float";   }
 template<> std::string typeName<double>()         { return "double";  }
 
+inline std::size_t typeSize(TypeId id) {
+    switch (id) {
+        case TypeId::INT8:   case TypeId::UINT8:  return 1;
+        case TypeId::INT16:  case TypeId::UINT16: return 2;
+        case TypeId::INT32:  case TypeId::UINT32: case TypeId::FLOAT: return 4;
+        case TypeId::DOUBLE: return 8;
+        default: return 0;
+    }
+}
+
+// calls f with a value of the C++ type behind id
+template <typename F>
+void visitType(TypeId id, F&& f) {
+    switch (id) {
+        case TypeId::INT8:   f(int8_t());   break;
+        case TypeId::UINT8:  f(uint8_t());  break;
+        case TypeId::INT16:  f(int16_t());  break;
+        case TypeId::UINT16: f(uint16_t()); break;
+        case TypeId::INT32:  f(int32_t());  break;
+        case TypeId::UINT32: f(uint32_t()); break;
+        case TypeId::FLOAT:  f(float());    break;
+        case TypeId::DOUBLE: f(double());   break;
+        default: throw std::runtime_error("PLY loader: unknown type.");
+    }
+}
+
+template <std::size_t Size> struct UIntOfSize;
+template <> struct UIntOfSize<1> { using type = uint8_t;  };
+template <> struct UIntOfSize<2> { using type = uint16_t; };
+template <> struct UIntOfSize<4> { using type = uint32_t; };
+template <> struct UIntOfSize<8> { using type = uint64_t; };
+
+template <typename T>
+T byteSwap(T value) {
+    using U = typename UIntOfSize<sizeof(T)>::type;
+    U u;
+    std::memcpy(&u, &value, sizeof(T));
+    if constexpr (sizeof(T) == 2) u = __builtin_bswap16(u);
+    else if constexpr (sizeof(T) == 4) u = __builtin_bswap32(u);
+    else if constexpr (sizeof(T) == 8) u = __builtin_bswap64(u);
+    std::memcpy(&value, &u, sizeof(T));
+    return value;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// pshufb reverses the bytes of every value in a 16 byte block, SSSE3 is not part of the
+// x86-64 baseline, so this is compiled for it on its own and picked at run time, returns
+// the number of values swapped, the rest is left to the scalar loop
+template <std::size_t Size>
+__attribute__((target("ssse3"))) std::size_t byteSwapSSSE3(char* bytes, std::size_t count) {
+    alignas(16) char order[16];
+    for (std::size_t i = 0; i < 16; ++i) order[i] = (char)(i / Size * Size + Size - 1 - i % Size);
+    auto shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(order));
+    auto nBlocks = count * Size / 16;
+    for (std::size_t i = 0; i < nBlocks; ++i) {
+        auto block = reinterpret_cast<__m128i*>(bytes + 16 * i);
+        _mm_storeu_si128(block, _mm_shuffle_epi8(_mm_loadu_si128(block), shuffle));
+    }
+    return nBlocks * 16 / Size;
+}
+
+inline bool hasSSSE3() {
+#ifdef __SSSE3__
+    return true;
+#else
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+#endif
+}
+#elif defined(__ARM_NEON)
+// NEON is always there on AArch64, vrev reverses the bytes of every value in a block
+template <std::size_t Size>
+std::size_t byteSwapNEON(char* bytes, std::size_t count) {
+    auto nBlocks = count * Size / 16;
+    for (std::size_t i = 0; i < nBlocks; ++i) {
+        auto block = reinterpret_cast<std::uint8_t*>(bytes + 16 * i);
+        auto v = vld1q_u8(block);
+        if constexpr (Size == 2) v = vrev16q_u8(v);
+        else if constexpr (Size == 4) v = vrev32q_u8(v);
+        else v = vrev64q_u8(v);
+        vst1q_u8(block, v);
+    }
+    return nBlocks * 16 / Size;
+}
+#endif
+
+// 16 bytes at a time with SSSE3 or NEON, the values that do not fill a block one by one
+template <typename T>
+void byteSwap(T* values, std::size_t count) {
+    using U = typename UIntOfSize<sizeof(T)>::type;
+    if constexpr (sizeof(T) > 1) {
+        std::size_t start = 0;
+#if defined(__x86_64__) || defined(__i386__)
+        if (hasSSSE3()) start = byteSwapSSSE3<sizeof(T)>(reinterpret_cast<char*>(values), count);
+#elif defined(__ARM_NEON)
+        start = byteSwapNEON<sizeof(T)>(reinterpret_cast<char*>(values), count);
+#endif
+        auto u = reinterpret_cast<U*>(values);
+        for (std::size_t i = start; i < count; ++i) {
+            if constexpr (sizeof(T) == 2) u[i] = __builtin_bswap16(u[i]);
+            else if constexpr (sizeof(T) == 4) u[i] = __builtin_bswap32(u[i]);
+            else u[i] = __builtin_bswap64(u[i]);
+        }
+    }
+}
+
+// binary rows have no alignment, values are copied out byte wise
+template <typename T>
+T loadValue(const char* p, bool swapBytes) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return swapBytes ? byteSwap(value) : value;
+}
+
+inline std::size_t loadListCount(const char* p, int listCountBytes, bool swapBytes) {
+    switch (listCountBytes) {
+        case 1: return loadValue<uint8_t>(p, swapBytes);
+        case 2: return loadValue<uint16_t>(p, swapBytes);
+        default: return loadValue<uint32_t>(p, swapBytes);
+    }
+}
+
+inline bool hostIsBigEndian() {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return true;
+#else
+    return false;
+#endif
+}
+
 template <typename T>
 struct TypeChain {
     static_assert(typeId<T>() != TypeId::UNKNOWN, "PLY Loader: unknown type.");
@@ -52,12 +194,20 @@ class Property {
 public:
     explicit Property(const std::string& name) noexcept : name(name) { }
     virtual ~Property() = default;
-    virtual void parse(std::istringstream& lineStream) = 0;
-    virtual void read(std::ifstream& stream) = 0;
+    // parses the value of row index from a text body, the buffers must have been resized
+    virtual void parse(const char*& p, const char* end, size_t index) = 0;
+    // reads one row's value at p and advances p
+    virtual void read(const char*& p, const char* end, bool swapBytes) = 0;
+    // reads the values of count fixed size rows, the first one at p, so only scalar properties support it
+    virtual void readColumn(const char* p, size_t stride, size_t count, bool swapBytes) = 0;
+    virtual TypeId getTypeId() const = 0;
+    // 0 for scalar properties
+    virtual int getListCountBytes() const = 0;
     virtual void writeHeader(std::ofstream& stream) const = 0;
     virtual void writeText(std::ofstream& stream, size_t iElement) const = 0;
     virtual void writeBinary(std::ofstream& stream, size_t iElement) const = 0;
     virtual void reserve(size_t count) = 0;
+    virtual void resize(size_t count) = 0;
     virtual size_t size() const = 0;
     virtual std::string getPropertyTypeName() const = 0;
 
@@ -77,16 +227,41 @@ public:
         : Property(name), data(std::move(data))
     { }
 
-    void parse(std::istringstream& lineStream) override {
-        T val;
-        lineStream >> val;
-        data.push_back(val);
+    void parse(const char*& p, const char* end, size_t index) override {
+        skipSpaces(p, end);
+        auto valid = false;
+        if constexpr (std::is_integral_v<T>) {
+            int64_t val;
+            valid = parseInt(p, end, val);
+            data[index] = (T)val;
+        } else {
+            valid = parseFloat(p, end, data[index]);
+        }
+        if (!valid) throw std::runtime_error("PLY loader: invalid value for property " + name + ".");
+    }
+
+    void read(const char*& p, const char* end, bool swapBytes) override {
+        if (end - p < (std::ptrdiff_t)sizeof(T))
+            throw std::runtime_error("PLY loader: unexpected end of file.");
+        data.push_back(loadValue<T>(p, swapBytes));
+        p += sizeof(T);
+    }
+
+    void readColumn(const char* p, size_t stride, size_t count, bool swapBytes) override {
+        auto offset = data.size();
+        data.resize(offset + count);
+        auto column = &data[offset];
+        for (size_t i = 0; i < count; ++i)
+            std::memcpy(column + i, p + i * stride, sizeof(T));
+        if (swapBytes) byteSwap(column, count);
+    }
+
+    TypeId getTypeId() const override {
+        return typeId<T>();
     }
 
-    void read(std::ifstream& stream) override {
-        T val;
-        stream.read((char*)&val, sizeof(T));
-        data.push_back(val);
+    int getListCountBytes() const override {
+        return 0;
     }
 
     void writeHeader(std::ofstream& stream) const override {
@@ -106,6 +281,10 @@ public:
         data.reserve(count);
     }
 
+    void resize(size_t count) override {
+        data.resize(count);
+    }
+
     size_t size() const override {
         return data.size();
     }
@@ -128,20 +307,6 @@ void TypedProperty<int8_t>::writeText(std::ofstream &stream, size_t iElement) co
     stream << (int)data[iElement] << " ";
 }
 
-template <>
-void TypedProperty<uint8_t>::parse(std::istringstream &lineStream) {
-    int val;
-    lineStream >> val;
-    data.push_back((uint8_t)val);
-}
-
-template <>
-void TypedProperty<int8_t>::parse(std::istringstream &lineStream) {
-    int val;
-    lineStream >> val;
-    data.push_back((int8_t)val);
-}
-
 template <typename T>
 class TypedListProperty : public Property {
 public:
@@ -159,30 +324,52 @@ public:
         stream << "property list uchar " << typeName<T>() << " " << name << std::endl;
     }
 
-    void parse(std::istringstream& lineStream) override {
-        int count;
-        lineStream >> count;
-        T val;
-        std::vector<T> vec;
-        for (auto i = 0; i < count; ++i) {
-            lineStream >> val;
-            vec.push_back(val);
+    void parse(const char*& p, const char* end, size_t index) override {
+        int64_t count;
+        skipSpaces(p, end);
+        if (!parseInt(p, end, count) || count < 0)
+            throw std::runtime_error("PLY loader: invalid list size for property " + name + ".");
+        auto& vec = data[index];
+        vec.resize(count);
+        for (auto& val : vec) {
+            skipSpaces(p, end);
+            auto valid = false;
+            if constexpr (std::is_integral_v<T>) {
+                int64_t v;
+                valid = parseInt(p, end, v);
+                val = (T)v;
+            } else {
+                valid = parseFloat(p, end, val);
+            }
+            if (!valid) throw std::runtime_error("PLY loader: invalid value for property " + name + ".");
         }
-        data.push_back(std::move(vec));
     }
 
-    void read(std::ifstream& stream) override {
-        int count = 0;
-        stream.read((char*)&count, listCountBytes);
-        T val;
-        std::vector<T> vec;
-        for (auto i = 0; i < count; ++i) {
-            stream.read((char*)&val, sizeof(T));
-            vec.push_back(val);
-        }
+    void read(const char*& p, const char* end, bool swapBytes) override {
+        if (end - p < listCountBytes)
+            throw std::runtime_error("PLY loader: unexpected end of file.");
+        auto count = loadListCount(p, listCountBytes, swapBytes);
+        p += listCountBytes;
+        if ((size_t)(end - p) < count * sizeof(T))
+            throw std::runtime_error("PLY loader: unexpected end of file.");
+        std::vector<T> vec(count);
+        for (size_t i = 0; i < count; ++i, p += sizeof(T))
+            vec[i] = loadValue<T>(p, swapBytes);
         data.push_back(std::move(vec));
     }
 
+    void readColumn(const char* p, size_t stride, size_t count, bool swapBytes) override {
+        throw std::runtime_error("PLY loader: list property " + name + " has no fixed size.");
+    }
+
+    TypeId getTypeId() const override {
+        return typeId<T>();
+    }
+
+    int getListCountBytes() const override {
+        return listCountBytes;
+    }
+
     void writeText(std::ofstream& stream, size_t iElement) const override {
         auto& elemList = data[iElement];
         auto count = (uint8_t)elemList.size();
@@ -207,6 +394,10 @@ public:
         data.reserve(count);
     }
 
+    void resize(size_t count) override {
+        data.resize(count);
+    }
+
     size_t size() const override {
         return data.size();
     }
@@ -242,32 +433,6 @@ void TypedListProperty<int8_t>::writeText(std::ofstream &stream, size_t iElement
     stream << " ";
 }
 
-template <>
-void TypedListProperty<uint8_t>::parse(std::istringstream &lineStream) {
-    int count;
-    lineStream >> count;
-    int val;
-    std::vector<uint8_t> vec;
-    for (auto i = 0; i < count; ++i) {
-        lineStream >> val;
-        vec.push_back((uint8_t)val);
-    }
-    data.push_back(std::move(vec));
-}
-
-template <>
-void TypedListProperty<int8_t>::parse(std::istringstream &lineStream) {
-    int count;
-    lineStream >> count;
-    int val;
-    std::vector<int8_t> vec;
-    for (auto i = 0; i < count; ++i) {
-        lineStream >> val;
-        vec.push_back((uint8_t)val);
-    }
-    data.push_back(std::move(vec));
-}
-
 Property* createProperty(
         bool isList, const std::string& name,
         const std::string& typeStr, const std::string& countTypeStr) {
@@ -453,6 +618,16 @@ public:
         return count;
     }
 
+    // bytes per row in a binary body, 0 if the element has list properties
+    size_t fixedStride() const {
+        size_t stride = 0;
+        for (auto& property : properties) {
+            if (property->getListCountBytes()) return 0;
+            stride += typeSize(property->getTypeId());
+        }
+        return stride;
+    }
+
 public:
     std::string name;
     size_t count;
@@ -461,16 +636,16 @@ public:
 
 enum class DataFormat { Text, Binary };
 
+constexpr std::size_t PlyTextRangeBytes = 1 << 22;
+
 class PLYData {
 public:
     PLYData() noexcept = default;
 
     explicit PLYData(const std::string& filename) {
-        std::ifstream file(filename, std::ios::binary);
-        if (file.fail()) throw std::runtime_error("PLY loader: could not open file " + filename + ".");
-        parseHeader(file);
-        if (inputFormat == DataFormat::Text) parseTextBody(file);
-        else parseBinaryBody(file);
+        MappedFile file(filename);
+        auto body = parseHeader(file.data(), file.end());
+        parseBody(body, file.end());
     }
 
     bool hasElement(const std::string& name) const {
@@ -507,7 +682,7 @@ public:
     std::vector<int> getVertexIndices() const {
         auto lists = getElement("face").getListProperty<int32_t>("vertex_indices");
         std::vector<int> indices;
-        indices.reserve(indices.size() * 6);
+        indices.reserve(lists.size() * 6);
         for (auto& list : lists) {
             if (list.size() != 3 && list.size() != 4) continue;
             indices.emplace_back(list[0]);
@@ -523,18 +698,26 @@ public:
         return indices;
     }
 
-    void parseHeader(std::istream& stream) {
-        std::string line;
-        while (std::getline(stream, line)) {
-            std::istringstream lineStream(line);
+    // returns the start of the body
+    const char* parseHeader(const char* begin, const char* end) {
+        for (auto p = begin; p < end; ) {
+            auto lineEnd = nextLine(p, end);
+            std::istringstream lineStream(std::string(p, lineEnd));
+            p = lineEnd;
             std::string token;
             lineStream >> token;
             if (token == "ply" || token == "PLY" || token == "comment") continue;
             else if (token == "format") parseFormatHeader(lineStream);
             else if (token == "element") parseElementHeader(lineStream);
             else if (token == "property") parsePropertyHeader(lineStream);
-            else if (token == "end_header") break;
+            else if (token == "end_header") return p;
         }
+        throw std::runtime_error("PLY loader: missing end_header.");
+    }
+
+    void parseBody(const char* begin, const char* end) {
+        if (inputFormat == DataFormat::Text) parseTextBody(begin, end);
+        else parseBinaryBody(begin, end);
     }
 
     void parseFormatHeader(std::istringstream& stream) {
@@ -543,7 +726,10 @@ public:
         if (version != "1.0") throw std::runtime_error("PLY loader: only version 1.0 is supported.");
         if (type == "ascii") inputFormat = DataFormat::Text;
         else if (type == "binary_little_endian") inputFormat = DataFormat::Binary;
-        else if (type == "binary_big_endian") throw std::runtime_error("PLY loader: big endian binary format not supported.");
+        else if (type == "binary_big_endian") {
+            inputFormat = DataFormat::Binary;
+            bigEndian = true;
+        }
         else throw std::runtime_error("PLY loader: unknown file format.");
     }
 
@@ -570,22 +756,93 @@ public:
         }
     }
 
-    void parseBinaryBody(std::ifstream& stream) {
-        for (auto& element : elements)
-            for (std::size_t i = 0; i < element.count; ++i)
-                for (auto& property : element.properties)
-                    property->read(stream);
+    bool swapBytes() const {
+        return bigEndian != hostIsBigEndian();
     }
 
-    void parseTextBody(std::ifstream& stream) {
-        for (auto& element : elements)
-            for (std::size_t i = 0; i < element.count; ++i) {
-                std::string line;
-                std::getline(stream, line);
-                std::istringstream lineStream(line);
-                for (auto& property : element.properties)
-                    property->parse(lineStream);
+    // elements without list properties are decoded a whole column at a time, the rest
+    // row by row
+    void parseBinaryBody(const char* p, const char* end) {
+        for (auto& element : elements) {
+            auto stride = element.fixedStride();
+            if (!stride) {
+                for (std::size_t i = 0; i < element.count; ++i)
+                    for (auto& property : element.properties)
+                        property->read(p, end, swapBytes());
+                continue;
+            }
+
+            if ((std::size_t)(end - p) / stride < element.count)
+                throw std::runtime_error("PLY loader: unexpected end of file.");
+            auto offset = (std::size_t)0;
+            for (auto& property : element.properties) {
+                property->readColumn(p + offset, stride, element.count, swapBytes());
+                offset += typeSize(property->getTypeId());
             }
+            p += stride * element.count;
+        }
+    }
+
+    // one row per line, blank lines are skipped, the body is cut into line aligned ranges
+    // and every range is parsed on the thread pool once its first row index is known
+    void parseTextBody(const char* begin, const char* end) {
+        std::vector<std::size_t> firstRows(1, 0);
+        for (auto& element : elements) {
+            for (auto& property : element.properties)
+                property->resize(element.count);
+            firstRows.push_back(firstRows.back() + element.count);
+        }
+        auto nRows = firstRows.back();
+
+        auto nRanges = std::max<std::size_t>((end - begin) / PlyTextRangeBytes, 1);
+        std::vector<const char*> rangeStarts(nRanges + 1, end);
+        rangeStarts[0] = begin;
+        for (std::size_t i = 1; i < nRanges; ++i)
+            rangeStarts[i] = nextLine(begin + (end - begin) / nRanges * i - 1, end);
+
+        parallelInit();
+
+        // every range except the last ends at a line start, so no line is split between ranges
+        std::vector<std::size_t> rangeRows(nRanges + 1, 0);
+        parallelFor1D([&](int64_t i) {
+            for (auto p = rangeStarts[i]; p < rangeStarts[i + 1];) {
+                auto lineEnd = nextLine(p, rangeStarts[i + 1]);
+                rangeRows[i + 1] += !isBlankLine(p, lineEnd);
+                p = lineEnd;
+            }
+        }, nRanges);
+        for (std::size_t i = 0; i < nRanges; ++i)
+            rangeRows[i + 1] += rangeRows[i];
+        if (rangeRows[nRanges] < nRows) {
+            parallelCleanup();
+            throw std::runtime_error("PLY loader: unexpected end of file.");
+        }
+
+        // exceptions can't leave a worker thread
+        std::vector<std::string> errors(nRanges);
+        parallelFor1D([&](int64_t i) {
+            try {
+                auto row = rangeRows[i];
+                auto e = std::upper_bound(firstRows.begin(), firstRows.end(), row) - firstRows.begin() - 1;
+                for (auto p = rangeStarts[i]; p < rangeStarts[i + 1] && row < nRows;) {
+                    auto lineEnd = nextLine(p, rangeStarts[i + 1]);
+                    if (!isBlankLine(p, lineEnd)) {
+                        while (row == firstRows[e + 1]) ++e;
+                        for (auto& property : elements[e].properties)
+                            property->parse(p, lineEnd, row - firstRows[e]);
+                        ++row;
+                    }
+                    p = lineEnd;
+                }
+            } catch (const std::exception& error) {
+                errors[i] = error.what();
+            }
+        }, nRanges);
+
+        parallelCleanup();
+
+        for (auto& error : errors)
+            if (!error.empty()) throw std::runtime_error(error);
     }
 
     void write(const std::string& filename, DataFormat format = DataFormat::Text) const {
@@ -608,13 +865,139 @@ public:
         stream << "end_header" << std::endl;
     }
 
+    // decodes vertex positions and triangulated face indices of a binary body straight into
+    // mesh buffers, skipping the per property vectors, returns false if the layout isn't
+    // one it handles
+    bool readMeshBuffers(const char* p, const char* end,
+                         std::vector<Vector3>& positions, std::vector<int>& indices) const {
+        if (inputFormat != DataFormat::Binary) return false;
+        auto foundVertices = false, foundFaces = false;
+        auto nVertices = hasElement("vertex") ? getElement("vertex").count : 0;
+
+        for (auto& element : elements) {
+            auto stride = element.fixedStride();
+            if (element.name == "vertex") {
+                if (!stride || !readPositions(element, p, end, positions)) return false;
+                foundVertices = true;
+            } else if (element.name == "face") {
+                if (!readTriangles(element, p, end, nVertices, indices)) return false;
+                foundFaces = true;
+            } else if (stride) {
+                if ((std::size_t)(end - p) / stride < element.count)
+                    throw std::runtime_error("PLY loader: unexpected end of file.");
+                p += stride * element.count;
+            } else {
+                return false;
+            }
+        }
+
+        return foundVertices && foundFaces;
+    }
+
+    bool readPositions(const Element& element, const char*& p, const char* end,
+                       std::vector<Vector3>& positions) const {
+        auto stride = element.fixedStride();
+        if ((std::size_t)(end - p) / stride < element.count)
+            throw std::runtime_error("PLY loader: unexpected end of file.");
+        if (!element.count) return false;
+
+        const Property* axes[3] = {};
+        std::size_t offsets[3] = {};
+        auto offset = (std::size_t)0;
+        for (auto& property : element.properties) {
+            for (auto axis = 0; axis < 3; ++axis)
+                if (property->name == std::string(1, "xyz"[axis])) {
+                    axes[axis] = property.get();
+                    offsets[axis] = offset;
+                }
+            offset += typeSize(property->getTypeId());
+        }
+        if (!axes[0] || !axes[1] || !axes[2]) return false;
+
+        positions.resize(element.count);
+        for (auto axis = 0; axis < 3; ++axis) {
+            visitType(axes[axis]->getTypeId(), [&](auto type) {
+                using T = decltype(type);
+                auto src = p + offsets[axis];
+                auto dst = &positions[0][axis];
+                if (swapBytes()) {
+                    for (std::size_t i = 0; i < element.count; ++i)
+                        dst[3 * i] = (Float)loadValue<T>(src + i * stride, true);
+                } else {
+                    for (std::size_t i = 0; i < element.count; ++i)
+                        dst[3 * i] = (Float)loadValue<T>(src + i * stride, false);
+                }
+            });
+        }
+        p += stride * element.count;
+        return true;
+    }
+
+    // faces keep the same triangulation as getVertexIndices, other face properties are skipped
+    bool readTriangles(const Element& element, const char*& p, const char* end,
+                       std::size_t nVertices, std::vector<int>& indices) const {
+        const Property* list = nullptr;
+        std::size_t prefixBytes = 0, suffixBytes = 0;
+        for (auto& property : element.properties) {
+            if (property->name == "vertex_indices") {
+                if (!property->getListCountBytes()) return false;
+                list = property.get();
+            } else if (property->getListCountBytes()) {
+                return false;
+            } else {
+                (list ? suffixBytes : prefixBytes) += typeSize(property->getTypeId());
+            }
+        }
+        if (!list || list->getTypeId() == TypeId::FLOAT || list->getTypeId() == TypeId::DOUBLE)
+            return false;
+
+        auto countBytes = list->getListCountBytes();
+        indices.clear();
+        indices.reserve(element.count * 3);
+        visitType(list->getTypeId(), [&](auto type) {
+            using T = decltype(type);
+            int v[4];
+            for (std::size_t i = 0; i < element.count; ++i) {
+                if ((std::size_t)(end - p) < prefixBytes + countBytes)
+                    throw std::runtime_error("PLY loader: unexpected end of file.");
+                p += prefixBytes;
+                auto count = loadListCount(p, countBytes, swapBytes());
+                p += countBytes;
+                if ((std::size_t)(end - p) < count * sizeof(T) + suffixBytes)
+                    throw std::runtime_error("PLY loader: unexpected end of file.");
+                if (count == 3 || count == 4) {
+                    for (std::size_t j = 0; j < count; ++j) {
+                        v[j] = (int)loadValue<T>(p + j * sizeof(T), swapBytes());
+                        if (v[j] < 0 || (std::size_t)v[j] >= nVertices)
+                            throw std::runtime_error("PLY loader: vertex index out of range.");
+                    }
+                    indices.insert(indices.end(), { v[0], v[1], v[2] });
+                    if (count == 4) indices.insert(indices.end(), { v[3], v[0], v[2] });
+                }
+                p += count * sizeof(T) + suffixBytes;
+            }
+        });
+        return true;
+    }
+
 public:
     DataFormat inputFormat = DataFormat::Text;
+    bool bigEndian = false;
     std::vector<Element> elements;
 };
 
-Mesh loadPLYMesh(const std::string& filename) {
-    PLYData ply(filename);
+inline Mesh loadPLYMesh(const std::string& filename) {
+    PhaseTimer timer(PhaseLoad);
+    MappedFile file(filename);
+    PLYData ply;
+    auto body = ply.parseHeader(file.data(), file.end());
+
+    std::vector<Vector3> positions;
+    std::vector<int> indices;
+    if (ply.readMeshBuffers(body, file.end(), positions, indices))
+        return Mesh(std::move(indices), std::move(positions));
+
+    ply.parseBody(body, file.end());
     return Mesh(
         ply.getVertexIndices(),
         ply.getVertexPositions(),
@@ -0,0 +1,316 @@
+#ifndef PT_UTILS_PTMLOADER_H
+#define PT_UTILS_PTMLOADER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <pt/core/stats.h>
+#include <pt/shapes/triangle.h>
+#include <pt/utils/mappedfile.h>
+
+namespace pt {
+
+// .ptm is a native mesh format meant to be used in place from a mapped file: a fixed
+// little endian header followed by one stream per vertex attribute, each stream starts
+// on a PtmAlignment boundary
+//
+//   positions  float32 x, y, z per vertex
+//   normals    octahedral encoded, two snorm16 per vertex (optional)
+//   uvs        float32 u, v per vertex (optional)
+//   indices    uint32 per index, or with PtmCompressedIndices the zigzag encoded delta to
+//              the previous index as a LEB128 varint
+//
+// uncompressed positions, uvs and indices are borrowed by the mesh when Float is float,
+// the file then stays mapped for as long as the mesh (or a copy of it) is alive
+
+constexpr std::uint32_t PtmMagic = 0x314d5450; // "PTM1"
+constexpr std::uint32_t PtmVersion = 1;
+constexpr std::uint64_t PtmAlignment = 64;
+
+enum PtmFlags : std::uint32_t {
+    PtmCompressedIndices = 1
+};
+
+enum PtmStreamId {
+    PtmPositions,
+    PtmNormals,
+    PtmUvs,
+    PtmIndices,
+    PtmStreamCount
+};
+
+struct PtmStream {
+    std::uint64_t offset;
+    std::uint64_t bytes;
+};
+
+struct PtmHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint32_t reserved;
+    std::uint64_t vertexCount;
+    std::uint64_t indexCount;
+    PtmStream streams[PtmStreamCount];
+};
+
+static_assert(sizeof(PtmHeader) == 96, "PtmHeader must match the on disk layout");
+
+inline std::int16_t toSnorm16(Float v) {
+    return (std::int16_t)std::lround(std::clamp(v, (Float)-1, (Float)1) * 32767);
+}
+
+inline Float fromSnorm16(std::int16_t v) {
+    return std::max((Float)v / 32767, (Float)-1);
+}
+
+// projects the unit sphere onto an octahedron and unfolds the lower half over the corners
+inline void encodeOctahedral(const Vector3& n, std::int16_t* out) {
+    auto l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0) {
+        out[0] = out[1] = 0;
+        return;
+    }
+    auto u = n.x / l1, v = n.y / l1;
+    if (n.z < 0) {
+        auto fu = (1 - std::abs(v)) * (u >= 0 ? 1 : -1);
+        auto fv = (1 - std::abs(u)) * (v >= 0 ? 1 : -1);
+        u = fu;
+        v = fv;
+    }
+    out[0] = toSnorm16(u);
+    out[1] = toSnorm16(v);
+}
+
+inline Vector3 decodeOctahedral(const std::int16_t* in) {
+    auto u = fromSnorm16(in[0]), v = fromSnorm16(in[1]);
+    auto z = 1 - std::abs(u) - std::abs(v);
+    if (z < 0) {
+        auto fu = (1 - std::abs(v)) * (u >= 0 ? 1 : -1);
+        auto fv = (1 - std::abs(u)) * (v >= 0 ? 1 : -1);
+        u = fu;
+        v = fv;
+    }
+    return normalize(Vector3(u, v, z));
+}
+
+inline void writeVarint(std::vector<std::uint8_t>& out, std::uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((std::uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((std::uint8_t)v);
+}
+
+inline bool readVarint(const std::uint8_t*& p, const std::uint8_t* end, std::uint32_t& v) {
+    v = 0;
+    for (auto shift = 0; shift < 35 && p < end; shift += 7) {
+        auto byte = *p++;
+        v |= (std::uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+inline std::vector<std::uint8_t> compressIndices(const Buffer<int>& indices) {
+    std::vector<std::uint8_t> bytes;
+    bytes.reserve(indices.size() * 2);
+    std::int32_t previous = 0;
+    for (auto index : indices) {
+        auto delta = (std::int32_t)((std::uint32_t)index - (std::uint32_t)previous);
+        writeVarint(bytes, ((std::uint32_t)delta << 1) ^ (std::uint32_t)(delta >> 31));
+        previous = index;
+    }
+    return bytes;
+}
+
+inline std::vector<int> decompressIndices(const char* data, std::size_t bytes, std::size_t count) {
+    std::vector<int> indices(count);
+    auto p = reinterpret_cast<const std::uint8_t*>(data);
+    auto end = p + bytes;
+    std::uint32_t previous = 0;
+    for (auto& index : indices) {
+        std::uint32_t zigzag;
+        if (!readVarint(p, end, zigzag))
+            throw std::runtime_error("Invalid compressed index stream!");
+        previous += (zigzag >> 1) ^ (0u - (zigzag & 1));
+        index = (int)previous;
+    }
+    if (p != end) throw std::runtime_error("Invalid compressed index stream!");
+    return indices;
+}
+
+inline void writePtmMesh(const std::string& filename, const Mesh& mesh, bool compress = false) {
+    if (mesh.indices.size() % 3)
+        throw std::runtime_error("Mesh indices are not a triangle list!");
+    if ((!mesh.normals.empty() && mesh.normals.size() != mesh.vertices.size()) ||
+        (!mesh.uvs.empty() && mesh.uvs.size() != mesh.vertices.size()))
+        throw std::runtime_error("Mesh attributes must have one value per vertex!");
+
+    std::vector<char> streams[PtmStreamCount];
+
+    auto& positions = streams[PtmPositions];
+    positions.resize(mesh.vertices.size() * 3 * sizeof(float));
+    auto pp = reinterpret_cast<float*>(positions.data());
+    for (auto& p : mesh.vertices) {
+        *pp++ = (float)p.x;
+        *pp++ = (float)p.y;
+        *pp++ = (float)p.z;
+    }
+
+    auto& normals = streams[PtmNormals];
+    normals.resize(mesh.normals.size() * 2 * sizeof(std::int16_t));
+    auto np = reinterpret_cast<std::int16_t*>(normals.data());
+    for (auto& n : mesh.normals) {
+        encodeOctahedral(n, np);
+        np += 2;
+    }
+
+    auto& uvs = streams[PtmUvs];
+    uvs.resize(mesh.uvs.size() * 2 * sizeof(float));
+    auto up = reinterpret_cast<float*>(uvs.data());
+    for (auto& uv : mesh.uvs) {
+        *up++ = (float)uv.x;
+        *up++ = (float)uv.y;
+    }
+
+    auto& indices = streams[PtmIndices];
+    if (compress) {
+        auto bytes = compressIndices(mesh.indices);
+        indices.assign(bytes.begin(), bytes.end());
+    } else {
+        indices.resize(mesh.indices.size() * sizeof(std::uint32_t));
+        std::memcpy(indices.data(), mesh.indices.data(), indices.size());
+    }
+
+    PtmHeader header = {};
+    header.magic = PtmMagic;
+    header.version = PtmVersion;
+    header.flags = compress ? (std::uint32_t)PtmCompressedIndices : 0u;
+    header.vertexCount = mesh.vertices.size();
+    header.indexCount = mesh.indices.size();
+
+    auto offset = (std::uint64_t)sizeof(PtmHeader);
+    for (auto i = 0; i < PtmStreamCount; ++i) {
+        offset = (offset + PtmAlignment - 1) / PtmAlignment * PtmAlignment;
+        header.streams[i].offset = offset;
+        header.streams[i].bytes = streams[i].size();
+        offset += streams[i].size();
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) throw std::runtime_error("Unable to open file: " + filename);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::uint64_t written = sizeof(header);
+    for (auto i = 0; i < PtmStreamCount; ++i) {
+        static const char padding[PtmAlignment] = {};
+        file.write(padding, header.streams[i].offset - written);
+        file.write(streams[i].data(), streams[i].size());
+        written = header.streams[i].offset + streams[i].size();
+    }
+    if (!file) throw std::runtime_error("Unable to write file: " + filename);
+}
+
+inline Mesh loadPtmMesh(const std::string& filename) {
+    static_assert(sizeof(Vector3) == 3 * sizeof(Float) && sizeof(Vector2f) == 2 * sizeof(Float),
+                  "Vector types must be tightly packed to borrow mesh streams");
+    PhaseTimer timer(PhaseLoad);
+
+    // the format is little endian and read in place
+    std::uint16_t one = 1;
+    if (*reinterpret_cast<const std::uint8_t*>(&one) != 1)
+        throw std::runtime_error("Loading .ptm files on big endian hosts is not supported!");
+
+    // pages are kept mapped and read in place, no sequential read ahead hint
+    auto file = std::make_shared<MappedFile>(filename, false);
+    if (file->size() < sizeof(PtmHeader))
+        throw std::runtime_error("Invalid .ptm file: " + filename);
+
+    PtmHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (header.magic != PtmMagic)
+        throw std::runtime_error("Invalid .ptm file: " + filename);
+    if (header.version != PtmVersion)
+        throw std::runtime_error("Unsupported .ptm version: " + filename);
+    if (header.vertexCount > (std::uint64_t)INT32_MAX || header.indexCount % 3)
+        throw std::runtime_error("Invalid .ptm file: " + filename);
+
+    auto vertexCount = (std::size_t)header.vertexCount;
+    auto indexCount = (std::size_t)header.indexCount;
+    auto compressed = (header.flags & PtmCompressedIndices) != 0;
+
+    // a stream is either absent or holds exactly the expected number of bytes, expected
+    // is ignored for variable length streams
+    auto stream = [&](PtmStreamId id, std::uint64_t expected, bool optional) -> const char* {
+        auto& s = header.streams[id];
+        if (optional && !s.bytes) return nullptr;
+        if (s.offset % PtmAlignment || s.offset > file->size() || s.bytes > file->size() - s.offset ||
+            (expected != ~std::uint64_t(0) && s.bytes != expected))
+            throw std::runtime_error("Invalid .ptm stream in file: " + filename);
+        return file->data() + s.offset;
+    };
+
+    auto positions = stream(PtmPositions, header.vertexCount * 3 * sizeof(float), false);
+    auto normals = stream(PtmNormals, header.vertexCount * 2 * sizeof(std::int16_t), true);
+    auto uvs = stream(PtmUvs, header.vertexCount * 2 * sizeof(float), true);
+    auto indices = stream(PtmIndices,
+        compressed ? ~std::uint64_t(0) : header.indexCount * sizeof(std::uint32_t), false);
+
+    Buffer<Vector3> vertexBuffer;
+    Buffer<Vector2f> uvBuffer;
+    if constexpr (sizeof(Float) == sizeof(float)) {
+        vertexBuffer = Buffer<Vector3>(reinterpret_cast<const Vector3*>(positions), vertexCount, file);
+        if (uvs) uvBuffer = Buffer<Vector2f>(reinterpret_cast<const Vector2f*>(uvs), vertexCount, file);
+    } else {
+        auto fp = reinterpret_cast<const float*>(positions);
+        std::vector<Vector3> converted(vertexCount);
+        for (auto& p : converted) {
+            p = Vector3(fp[0], fp[1], fp[2]);
+            fp += 3;
+        }
+        vertexBuffer = std::move(converted);
+        if (uvs) {
+            auto fuv = reinterpret_cast<const float*>(uvs);
+            std::vector<Vector2f> convertedUvs(vertexCount);
+            for (auto& uv : convertedUvs) {
+                uv = Vector2f(fuv[0], fuv[1]);
+                fuv += 2;
+            }
+            uvBuffer = std::move(convertedUvs);
+        }
+    }
+
+    Buffer<Vector3> normalBuffer;
+    if (normals) {
+        auto np = reinterpret_cast<const std::int16_t*>(normals);
+        std::vector<Vector3> decoded(vertexCount);
+        for (auto& n : decoded) {
+            n = decodeOctahedral(np);
+            np += 2;
+        }
+        normalBuffer = std::move(decoded);
+    }
+
+    Buffer<int> indexBuffer;
+    if (compressed)
+        indexBuffer = decompressIndices(indices, header.streams[PtmIndices].bytes, indexCount);
+    else
+        indexBuffer = Buffer<int>(reinterpret_cast<const int*>(indices), indexCount, file);
+
+    for (auto index : indexBuffer) {
+        if ((std::uint32_t)index >= header.vertexCount)
+            throw std::runtime_error("Vertex index out of range in file: " + filename);
+    }
+
+    return Mesh(std::move(indexBuffer), std::move(vertexBuffer), std::move(normalBuffer), std::move(uvBuffer));
+}
+
+}
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef PT_UTILS_SOCKET_H
+#define PT_UTILS_SOCKET_H
+
+#include <string>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <poll.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+namespace pt {
+
+// blocking TCP connection, failures throw so that a lost peer can be handled in one place
+class Socket {
+public:
+    Socket() noexcept = default;
+
+    explicit Socket(int fd) noexcept : fd(fd)
+    { }
+
+    Socket(Socket&& other) noexcept : fd(other.fd) {
+        other.fd = -1;
+    }
+
+    Socket& operator=(Socket&& other) noexcept {
+        if (this != &other) {
+            close();
+            fd = other.fd;
+            other.fd = -1;
+        }
+        return *this;
+    }
+
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    ~Socket() noexcept {
+        close();
+    }
+
+    // host is a name or an address, localhost works as well as another machine
+    static Socket connect(const std::string& host, std::uint16_t port) {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses;
+        auto service = std::to_string(port);
+        if (getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses) != 0)
+            throw std::runtime_error("Unable to resolve host: " + host);
+
+        Socket socket;
+        for (auto address = addresses; address; address = address->ai_next) {
+            socket = Socket(::socket(address->ai_family, address->ai_socktype, address->ai_protocol));
+            if (socket.fd != -1 && ::connect(socket.fd, address->ai_addr, address->ai_addrlen) == 0) break;
+            socket.close();
+        }
+        freeaddrinfo(addresses);
+        if (socket.fd == -1) throw std::runtime_error("Unable to connect to " + host + ":" + service);
+        socket.setNoDelay();
+        return socket;
+    }
+
+    // listens on every interface, or only on 127.0.0.1 for services meant for this machine
+    static Socket listen(std::uint16_t port, bool loopbackOnly = false, int backlog = 64) {
+        Socket socket(::socket(loopbackOnly ? AF_INET : AF_INET6, SOCK_STREAM, 0));
+        if (socket.fd == -1) throw std::runtime_error("Unable to create socket!");
+        int on = 1, off = 0;
+        setsockopt(socket.fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        auto bound = false;
+        if (loopbackOnly) {
+            sockaddr_in address;
+            std::memset(&address, 0, sizeof(address));
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = htons(port);
+            bound = bind(socket.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        } else {
+            setsockopt(socket.fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+            sockaddr_in6 address;
+            std::memset(&address, 0, sizeof(address));
+            address.sin6_family = AF_INET6;
+            address.sin6_addr = in6addr_any;
+            address.sin6_port = htons(port);
+            bound = bind(socket.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        }
+        if (!bound || ::listen(socket.fd, backlog) != 0)
+            throw std::runtime_error("Unable to listen on port " + std::to_string(port));
+        return socket;
+    }
+
+    // waits at most timeout milliseconds, the returned socket is invalid if nobody connected
+    Socket accept(int timeout) const {
+        pollfd request { fd, POLLIN, 0 };
+        if (poll(&request, 1, timeout) <= 0) return Socket();
+        Socket socket(::accept(fd, nullptr, nullptr));
+        if (socket.valid()) socket.setNoDelay();
+        return socket;
+    }
+
+    void sendAll(const void* data, std::size_t size) const {
+        auto bytes = static_cast<const char*>(data);
+        while (size) {
+            auto n = ::send(fd, bytes, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("Connection lost while sending!");
+            bytes += n;
+            size -= (std::size_t)n;
+        }
+    }
+
+    void recvAll(void* data, std::size_t size) const {
+        auto bytes = static_cast<char*>(data);
+        while (size) {
+            auto n = ::recv(fd, bytes, size, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("Connection lost while receiving!");
+            bytes += n;
+            size -= (std::size_t)n;
+        }
+    }
+
+    // reads a line of a text protocol without its line break, returns false when the peer
+    // closed the connection before the line started
+    bool recvLine(std::string& line, std::size_t maxLength = 4096) const {
+        line.clear();
+        while (true) {
+            char c;
+            auto n = ::recv(fd, &c, 1, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0 && line.empty()) return false;
+            if (n <= 0) throw std::runtime_error("Connection lost while receiving!");
+            if (c == '\n') break;
+            if (line.size() == maxLength) throw std::runtime_error("Line too long!");
+            line += c;
+        }
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return true;
+    }
+
+    void sendLine(const std::string& line) const {
+        auto data = line + "\n";
+        sendAll(data.data(), data.size());
+    }
+
+    template <typename T>
+    void send(const T& value) const {
+        sendAll(&value, sizeof(T));
+    }
+
+    template <typename T>
+    T recv() const {
+        T value;
+        recvAll(&value, sizeof(T));
+        return value;
+    }
+
+    bool valid() const {
+        return fd != -1;
+    }
+
+private:
+    // the messages are small and answered one at a time, Nagle's algorithm would delay them
+    void setNoDelay() {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    void close() {
+        if (fd != -1) ::close(fd);
+        fd = -1;
+    }
+
+    int fd = -1;
+};
+
+}
+
+#endif
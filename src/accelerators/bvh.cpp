@@ -1,4 +1,7 @@
+#include <queue>
 #include <algorithm>
+#include <pt/core/parallel.h>
+#include <pt/core/trace.h>
 #include <pt/accelerators/bvh.h>
 
 namespace pt {
@@ -38,12 +41,42 @@ struct BVHNode {
     int splitAxis, primsOffset, nPrims;
 };
 
+#ifdef PT_BVH_COMPRESSED
+// decoding used by both compression and traversal, so both see exactly the same boxes
+static Bounds3 dequantize(const Bounds3& parent, const uint8_t qMin[3], const uint8_t qMax[3]) {
+    Bounds3 bounds;
+    for (auto axis = 0; axis < 3; ++axis) {
+        auto lo = parent.pMin[axis], hi = parent.pMax[axis];
+        auto scale = (hi - lo) * ((Float)1 / 255);
+        bounds.pMin[axis] = qMin[axis] == 0 ? lo : lo + qMin[axis] * scale;
+        bounds.pMax[axis] = qMax[axis] == 255 ? hi : lo + qMax[axis] * scale;
+    }
+    return bounds;
+}
+
+static void quantize(const Bounds3& parent, const Bounds3& bounds, uint8_t qMin[3], uint8_t qMax[3]) {
+    for (auto axis = 0; axis < 3; ++axis) {
+        auto lo = parent.pMin[axis], hi = parent.pMax[axis];
+        auto inv = hi > lo ? 255 / (hi - lo) : 0;
+        qMin[axis] = (uint8_t)std::clamp(std::floor((bounds.pMin[axis] - lo) * inv), (Float)0, (Float)255);
+        qMax[axis] = (uint8_t)std::clamp(std::ceil((bounds.pMax[axis] - lo) * inv), (Float)0, (Float)255);
+    }
+
+    // the estimate above may be off by one after rounding, widen until the decoded box is conservative
+    for (auto axis = 0; axis < 3; ++axis) {
+        while (qMin[axis] > 0 && dequantize(parent, qMin, qMax).pMin[axis] > bounds.pMin[axis]) --qMin[axis];
+        while (qMax[axis] < 255 && dequantize(parent, qMin, qMax).pMax[axis] < bounds.pMax[axis]) ++qMax[axis];
+    }
+}
+#endif
+
 struct Bucket {
     int count = 0;
     Bounds3 bounds;
 };
 
 BVHAccel::BVHAccel(std::vector<Primitive*>&& prims) noexcept : primitives(std::move(prims)) {
+    PhaseTimer timer(PhaseBuild);
     auto size = primitives.size();
     std::vector<PrimInfo> primInfos;
     primInfos.reserve(size);
@@ -51,38 +84,57 @@ BVHAccel::BVHAccel(std::vector<Primitive*>&& prims) noexcept : primitives(std::m
         primInfos.emplace_back(i, primitives[i]->worldBound());
 
     int totalNodes = 0;
-    std::vector<Primitive*> orderedPrims;
-    orderedPrims.reserve(size);
-    auto root = sahBuild(primInfos, 0, size, totalNodes, orderedPrims);
-    primitives = std::move(orderedPrims);
-
-    nodes.reserve(totalNodes);
-    flattenBVHTree(root);
-    destroyBVHTree(root);
+    BVHNode* root;
+    // the build runs on the calling thread, each stage is one span of the whole tree
+    {
+        TraceScope scope("bvh sah build, whole tree", "build");
+        // leaves collect input indices, kept as the ids reported to the integrator
+        primitiveIds.reserve(size);
+        root = sahBuild(primInfos, 0, size, totalNodes, primitiveIds);
+        std::vector<Primitive*> orderedPrims;
+        orderedPrims.reserve(size);
+        for (auto id : primitiveIds) orderedPrims.push_back(primitives[id]);
+        primitives = std::move(orderedPrims);
+    }
+
+    {
+        TraceScope scope("bvh flatten, whole tree", "build", "nodes", totalNodes);
+        nodes.reserve(totalNodes + 1);
+        flattenBVHTree(root);
+        destroyBVHTree(root);
+    }
+
+#ifdef PT_BVH_COMPRESSED
+    TraceScope compressScope("bvh compress, whole tree", "build");
+    compressBVHTree();
+#endif
 }
 
 BVHNode* BVHAccel::createLeafNode(
     std::vector<PrimInfo>& primInfos,
     int start, int end, int& totalNodes,
-    std::vector<Primitive*>& orderedPrims) const {
+    std::vector<int>& orderedIds) const {
 
     ++totalNodes;
     Bounds3 bounds;
+    // children are built as constructor arguments, whose evaluation order is unspecified,
+    // so the leaf offset must come from orderedIds rather than from start
+    auto primsOffset = (int)orderedIds.size();
     for (auto i = start; i < end; ++i) {
         bounds.expandBy(primInfos[i].bounds);
-        orderedPrims.push_back(primitives[primInfos[i].primIndex]);
+        orderedIds.push_back(primInfos[i].primIndex);
     }
-    return new BVHNode(bounds, start, end - start);
+    return new BVHNode(bounds, primsOffset, end - start);
 }
 
 BVHNode* BVHAccel::exhaustBuild(
     std::vector<PrimInfo>& primInfos,
     int start, int end, int& totalNodes,
-    std::vector<Primitive*>& orderedPrims) const {
+    std::vector<int>& orderedIds) const {
     
     auto nPrims = end - start;
     if (nPrims == 1)
-        return createLeafNode(primInfos, start, end, totalNodes, orderedPrims);
+        return createLeafNode(primInfos, start, end, totalNodes, orderedIds);
 
     Float totalAreaInv;
     Bounds3 totalBounds;
@@ -122,7 +174,7 @@ BVHNode* BVHAccel::exhaustBuild(
     }
 
     if (splitAxis == -1)
-        return createLeafNode(primInfos, start, end, totalNodes, orderedPrims);
+        return createLeafNode(primInfos, start, end, totalNodes, orderedIds);
 
     std::sort(&primInfos[start], &primInfos[end - 1] + 1, [=](auto& a, auto& b) {
         return a.center[splitAxis] < b.center[splitAxis];
@@ -131,22 +183,22 @@ BVHNode* BVHAccel::exhaustBuild(
     ++totalNodes;
     return new BVHNode(
         totalBounds, splitAxis,
-        exhaustBuild(primInfos, start, start + splitPrim + 1, totalNodes, orderedPrims),
-        exhaustBuild(primInfos, start + splitPrim + 1, end, totalNodes, orderedPrims)
+        exhaustBuild(primInfos, start, start + splitPrim + 1, totalNodes, orderedIds),
+        exhaustBuild(primInfos, start + splitPrim + 1, end, totalNodes, orderedIds)
     );
 }
 
 BVHNode* BVHAccel::sahBuild(
     std::vector<PrimInfo>& primInfos,
     int start, int end, int& totalNodes,
-    std::vector<Primitive*>& orderedPrims) const {
+    std::vector<int>& orderedIds) const {
 
     auto nPrims = end - start;
     if (nPrims == 1) 
-        return createLeafNode(primInfos, start, end, totalNodes, orderedPrims);
+        return createLeafNode(primInfos, start, end, totalNodes, orderedIds);
 
     if (nPrims < SAH_APPLY_COUNT)
-        return exhaustBuild(primInfos, start, end, totalNodes, orderedPrims);
+        return exhaustBuild(primInfos, start, end, totalNodes, orderedIds);
 
     Bounds3 centerBounds;
     for (auto i = start; i < end; ++i)
@@ -154,7 +206,7 @@ BVHNode* BVHAccel::sahBuild(
     int dim = centerBounds.maxExtent();
 
     if (centerBounds.pMax[dim] - centerBounds.pMin[dim] < (Float)(0.00001))
-        return createLeafNode(primInfos, start, end, totalNodes, orderedPrims);
+        return createLeafNode(primInfos, start, end, totalNodes, orderedIds);
 
     Bucket buckets[BUCKETS];
     auto dist = centerBounds.pMax[dim] - centerBounds.pMin[dim];
@@ -190,7 +242,7 @@ BVHNode* BVHAccel::sahBuild(
     }
 
     if (splitBucket == -1)
-        return exhaustBuild(primInfos, start, end, totalNodes, orderedPrims);
+        return exhaustBuild(primInfos, start, end, totalNodes, orderedIds);
 
     auto pmid = std::partition(&primInfos[start], &primInfos[end - 1] + 1, [=](auto& p) {
         auto offset = p.center[dim] - centerBounds.pMin[dim];
@@ -203,8 +255,8 @@ BVHNode* BVHAccel::sahBuild(
     ++totalNodes;
     return new BVHNode(
         totalBounds, dim,
-        sahBuild(primInfos, start, mid, totalNodes, orderedPrims),
-        sahBuild(primInfos, mid, end, totalNodes, orderedPrims)
+        sahBuild(primInfos, start, mid, totalNodes, orderedIds),
+        sahBuild(primInfos, mid, end, totalNodes, orderedIds)
     );
 }
 
@@ -217,79 +269,384 @@ void BVHAccel::destroyBVHTree(const BVHNode* node) const {
     delete node;
 }
 
-void BVHAccel::flattenBVHTree(const BVHNode* node) {
-    if (node->nPrims) {
+void BVHAccel::addLinearNode(const BVHNode* node) {
+    if (node->nPrims)
         nodes.emplace_back(node->bounds, node->primsOffset, (uint16_t)node->nPrims);
-    } else {
-        nodes.emplace_back(node->bounds, node->splitAxis);
-        auto& linearNode = nodes.back();
-        flattenBVHTree(node->left);
-        linearNode.rightChild = (int)nodes.size();
-        flattenBVHTree(node->right);
+    else
+        nodes.emplace_back(node->bounds, (uint16_t)node->splitAxis);
+}
+
+// Nodes are laid out in page sized treelets. Each treelet is grown greedily from its root,
+// always expanding the interior node with the largest surface area, i.e. the node most
+// likely to be visited. Subtrees left over when a treelet is full become new treelets.
+void BVHAccel::flattenBVHTree(const BVHNode* root) {
+    struct Candidate {
+        const BVHNode* node;
+        int index;
+
+        bool operator<(const Candidate& c) const {
+            return node->bounds.area() < c.node->bounds.area();
+        }
+    };
+
+    addLinearNode(root);
+    if (root->nPrims) return;
+
+    // padding so that every sibling pair starts at an even index
+    nodes.push_back(nodes[0]);
+
+    std::queue<Candidate> treeletRoots;
+    treeletRoots.push({ root, 0 });
+
+    while (!treeletRoots.empty()) {
+        std::priority_queue<Candidate> candidates;
+        candidates.push(treeletRoots.front());
+        treeletRoots.pop();
+
+        for (auto pairs = 0; pairs < TREELET_PAIRS && !candidates.empty(); ++pairs) {
+            auto candidate = candidates.top();
+            candidates.pop();
+            auto offset = (int)nodes.size();
+            nodes[candidate.index].childrenOffset = offset;
+            addLinearNode(candidate.node->left);
+            addLinearNode(candidate.node->right);
+            if (!candidate.node->left->nPrims) candidates.push({ candidate.node->left, offset });
+            if (!candidate.node->right->nPrims) candidates.push({ candidate.node->right, offset + 1 });
+        }
+
+        while (!candidates.empty()) {
+            treeletRoots.push(candidates.top());
+            candidates.pop();
+        }
     }
 }
 
-bool BVHAccel::intersect(const Ray& ray, Interaction& isect) const {
+#ifdef PT_BVH_COMPRESSED
+void BVHAccel::compressBVHTree() {
+    rootBounds = nodes[0].bounds;
+    compressedNodes.resize(nodes.size());
+
+    // children are quantized against the decoded parent box, not the exact one,
+    // because that is the only box traversal has
+    std::vector<std::pair<int, Bounds3>> todo;
+    auto& root = compressedNodes[0];
+    for (auto axis = 0; axis < 3; ++axis) {
+        root.qMin[axis] = 0;
+        root.qMax[axis] = 255;
+    }
+    todo.emplace_back(0, rootBounds);
+
+    while (!todo.empty()) {
+        auto [index, bounds] = todo.back();
+        todo.pop_back();
+        auto& node = nodes[index];
+        auto& compressedNode = compressedNodes[index];
+        compressedNode.nPrims = node.nPrims;
+        compressedNode.splitAxis = node.splitAxis;
+        if (node.nPrims) {
+            compressedNode.offset = node.primsOffset;
+            continue;
+        }
+        compressedNode.offset = node.childrenOffset;
+        for (auto child = node.childrenOffset; child < node.childrenOffset + 2; ++child) {
+            auto& compressedChild = compressedNodes[child];
+            quantize(bounds, nodes[child].bounds, compressedChild.qMin, compressedChild.qMax);
+            todo.emplace_back(child, dequantize(bounds, compressedChild.qMin, compressedChild.qMax));
+        }
+    }
+
+    nodes.clear();
+    nodes.shrink_to_fit();
+}
+
+template <typename Visitor>
+bool BVHAccel::traverse(const Ray& ray, RayStats& rayStats, Visitor&& visitLeaf) const {
+    Vector3 invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    const int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+    // decoded boxes travel on the stack, a node's box depends on all of its ancestors
+    std::pair<int, Bounds3> nodesToVisit[64];
+    nodesToVisit[0] = { 0, rootBounds };
+    auto toVisitOffset = 0;
+
+    while (toVisitOffset != -1) {
+        auto [currentIndex, bounds] = nodesToVisit[toVisitOffset--];
+        auto& node = compressedNodes[currentIndex];
+        rayStats.testBox();
+        if (!bounds.intersect(ray, invDir, dirIsNeg)) continue;
+        rayStats.visitNode();
+        if (node.nPrims) {
+            if (visitLeaf(node.offset, node.nPrims)) return true;
+            continue;
+        }
+        auto& left = compressedNodes[node.offset];
+        auto& right = compressedNodes[node.offset + 1];
+        prefetch(&left);
+        auto leftBounds = dequantize(bounds, left.qMin, left.qMax);
+        auto rightBounds = dequantize(bounds, right.qMin, right.qMax);
+        if (dirIsNeg[node.splitAxis]) {
+            nodesToVisit[++toVisitOffset] = { node.offset, leftBounds };
+            nodesToVisit[++toVisitOffset] = { node.offset + 1, rightBounds };
+        } else {
+            nodesToVisit[++toVisitOffset] = { node.offset + 1, rightBounds };
+            nodesToVisit[++toVisitOffset] = { node.offset, leftBounds };
+        }
+    }
+
+    return false;
+}
+#else
+template <typename Visitor>
+bool BVHAccel::traverse(const Ray& ray, RayStats& rayStats, Visitor&& visitLeaf) const {
     Vector3 invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
     const int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
 
-    auto hit = false;
     int nodesToVisit[64];
     nodesToVisit[0] = 0;
-    int currentIndex, toVisitOffset = 0;
-    
+    auto toVisitOffset = 0;
+
     while (toVisitOffset != -1) {
-        currentIndex = nodesToVisit[toVisitOffset--];
-        auto& node = nodes[currentIndex];
-        if (node.bounds.intersect(ray, invDir, dirIsNeg)) {
-            if (node.nPrims) {
-                for (auto i = 0; i < node.nPrims; ++i)
-                    if (primitives[node.primsOffset + i]->intersect(ray, isect))
-                        hit = true;
-            } else {
-                if (dirIsNeg[node.splitAxis]) {
-                    nodesToVisit[++toVisitOffset] = currentIndex + 1;
-                    nodesToVisit[++toVisitOffset] = node.rightChild;
-                } else {
-                    nodesToVisit[++toVisitOffset] = node.rightChild;
-                    nodesToVisit[++toVisitOffset] = currentIndex + 1;
-                }
-            }
+        auto& node = nodes[nodesToVisit[toVisitOffset--]];
+        rayStats.testBox();
+        if (!node.bounds.intersect(ray, invDir, dirIsNeg)) continue;
+        rayStats.visitNode();
+        if (node.nPrims) {
+            if (visitLeaf(node.primsOffset, node.nPrims)) return true;
+            continue;
+        }
+        prefetch(&nodes[node.childrenOffset]);
+        if (dirIsNeg[node.splitAxis]) {
+            nodesToVisit[++toVisitOffset] = node.childrenOffset;
+            nodesToVisit[++toVisitOffset] = node.childrenOffset + 1;
+        } else {
+            nodesToVisit[++toVisitOffset] = node.childrenOffset + 1;
+            nodesToVisit[++toVisitOffset] = node.childrenOffset;
         }
     }
 
+    return false;
+}
+#endif
+
+bool BVHAccel::intersect(const Ray& ray, Interaction& isect) const {
+    auto hit = false;
+    RayStats rayStats;
+    traverse(ray, rayStats, [&](int primsOffset, int nPrims) {
+        rayStats.testPrims(nPrims);
+        for (auto i = 0; i < nPrims; ++i) {
+            if (primitives[primsOffset + i]->intersect(ray, isect)) {
+                isect.primitiveId = primitiveIds[primsOffset + i];
+                hit = true;
+            }
+        }
+        return false;
+    });
+    rayStats.record(ClosestRay, hit);
     return hit;
 }
 
 bool BVHAccel::intersect(const Ray& ray) const {
-    Vector3 invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
-    const int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+    RayStats rayStats;
+    auto hit = traverse(ray, rayStats, [&](int primsOffset, int nPrims) {
+        for (auto i = 0; i < nPrims; ++i) {
+            rayStats.testPrims(1);
+            if (primitives[primsOffset + i]->intersect(ray))
+                return true;
+        }
+        return false;
+    });
+    rayStats.record(ShadowRay, hit);
+    return hit;
+}
+
+static int first(std::uint32_t mask) {
+    auto i = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        ++i;
+    }
+    return i;
+}
+
+// Packet traversal visits a node once for all rays whose masks are still set. Coherent
+// packets are culled with a single interval test before any per ray slab test.
+void BVHAccel::intersect(RayPacket<PacketSize>& packet, Interaction* isects) const {
+    if (!packet.count) return;
+
+#ifdef PT_BVH_COMPRESSED
+    struct Entry { int index; std::uint32_t mask; Bounds3 bounds; };
+    Entry nodesToVisit[64];
+    nodesToVisit[0] = { 0, packet.activeMask(), rootBounds };
+#else
+    struct Entry { int index; std::uint32_t mask; };
+    Entry nodesToVisit[64];
+    nodesToVisit[0] = { 0, packet.activeMask() };
+#endif
+    auto toVisitOffset = 0;
+    RayStats rayStats[PacketSize];
 
-    int nodesToVisit[64];
-    nodesToVisit[0] = 0;
-    int currentIndex, toVisitOffset = 0;
-    
     while (toVisitOffset != -1) {
-        currentIndex = nodesToVisit[toVisitOffset--];
-        auto& node = nodes[currentIndex];
-        if (node.bounds.intersect(ray, invDir, dirIsNeg)) {
-            if (node.nPrims) {
-                for (auto i = 0; i < node.nPrims; ++i)
-                    if (primitives[node.primsOffset + i]->intersect(ray))
-                        return true;                        
-            } else {
-                if (dirIsNeg[node.splitAxis]) {
-                    nodesToVisit[++toVisitOffset] = currentIndex + 1;
-                    nodesToVisit[++toVisitOffset] = node.rightChild;
-                } else {
-                    nodesToVisit[++toVisitOffset] = node.rightChild;
-                    nodesToVisit[++toVisitOffset] = currentIndex + 1;
+        auto entry = nodesToVisit[toVisitOffset--];
+#ifdef PT_BVH_COMPRESSED
+        auto& node = compressedNodes[entry.index];
+        auto& bounds = entry.bounds;
+        auto offset = (int)node.offset;
+#else
+        auto& node = nodes[entry.index];
+        auto& bounds = node.bounds;
+        auto offset = node.nPrims ? node.primsOffset : node.childrenOffset;
+#endif
+        if (packet.coherent && !packet.intersectInterval(bounds)) continue;
+
+        // in a coherent packet, rays before the first one hitting the box are dropped and later
+        // rays stay active untested, they are checked against the box again at the leaves
+        auto mask = entry.mask;
+        if (packet.coherent) {
+            while (mask) {
+                auto i = first(mask);
+                rayStats[i].testBox();
+                if (bounds.intersect(packet.rays[i], packet.invDirs[i], packet.dirIsNeg[i])) break;
+                mask &= mask - 1;
+            }
+        } else {
+            for (auto i = first(mask); i < packet.count; ++i) {
+                if (!(mask & (1u << i))) continue;
+                rayStats[i].testBox();
+                if (!bounds.intersect(packet.rays[i], packet.invDirs[i], packet.dirIsNeg[i]))
+                    mask &= ~(1u << i);
+            }
+        }
+        if (!mask) continue;
+        for (auto i = first(mask); i < packet.count; ++i)
+            if (mask & (1u << i)) rayStats[i].visitNode();
+
+        if (node.nPrims) {
+            for (auto i = first(mask); i < packet.count; ++i) {
+                if (!(mask & (1u << i))) continue;
+                if (packet.coherent) {
+                    rayStats[i].testBox();
+                    if (!bounds.intersect(packet.rays[i], packet.invDirs[i], packet.dirIsNeg[i]))
+                        continue;
+                }
+                rayStats[i].testPrims(node.nPrims);
+                for (auto j = 0; j < node.nPrims; ++j) {
+                    if (primitives[offset + j]->intersect(packet.rays[i], isects[i])) {
+                        isects[i].primitiveId = primitiveIds[offset + j];
+                        packet.hitMask |= 1u << i;
+                    }
                 }
             }
+            continue;
+        }
+
+        // order children by the direction of the first active ray
+#ifdef PT_BVH_COMPRESSED
+        auto& left = compressedNodes[offset];
+        auto& right = compressedNodes[offset + 1];
+        prefetch(&left);
+        Entry leftEntry { offset, mask, dequantize(bounds, left.qMin, left.qMax) };
+        Entry rightEntry { offset + 1, mask, dequantize(bounds, right.qMin, right.qMax) };
+#else
+        prefetch(&nodes[offset]);
+        Entry leftEntry { offset, mask };
+        Entry rightEntry { offset + 1, mask };
+#endif
+        if (packet.dirIsNeg[first(mask)][node.splitAxis]) {
+            nodesToVisit[++toVisitOffset] = leftEntry;
+            nodesToVisit[++toVisitOffset] = rightEntry;
+        } else {
+            nodesToVisit[++toVisitOffset] = rightEntry;
+            nodesToVisit[++toVisitOffset] = leftEntry;
         }
     }
 
-    return false;
+    for (auto i = 0; i < packet.count; ++i)
+        rayStats[i].record(ClosestRay, packet.hit(i));
+}
+
+static std::uint64_t expandBits(std::uint64_t v) {
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v <<  8)) & 0x0300F00F;
+    v = (v | (v <<  4)) & 0x030C30C3;
+    v = (v | (v <<  2)) & 0x09249249;
+    return v;
+}
+
+// sort key is the direction octant followed by the morton code of the origin, so rays
+// that are close in the stream start close together and traverse the same nodes
+std::vector<int64_t> BVHAccel::sortRaysForCoherence(const Ray* rays, int64_t count) const {
+    Bounds3 originBounds;
+    for (int64_t i = 0; i < count; ++i)
+        originBounds.expandBy(rays[i].o);
+    auto diag = originBounds.diag();
+
+    std::vector<std::pair<std::uint64_t, int64_t>> keys(count);
+    parallelFor1D([&](int64_t i) {
+        auto& ray = rays[i];
+        std::uint64_t octant = (ray.d.x < 0) | (ray.d.y < 0) << 1 | (ray.d.z < 0) << 2;
+        std::uint64_t morton = 0;
+        for (auto axis = 0; axis < 3; ++axis) {
+            auto offset = diag[axis] > 0 ? (ray.o[axis] - originBounds.pMin[axis]) / diag[axis] : 0;
+            morton |= expandBits((std::uint64_t)std::min(offset * 1024, (Float)1023)) << (2 - axis);
+        }
+        keys[i] = { octant << 30 | morton, i };
+    }, count, RAY_STREAM_CHUNK_SIZE);
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<int64_t> order;
+    order.reserve(count);
+    for (auto& key : keys) order.push_back(key.second);
+    return order;
+}
+
+void BVHAccel::intersect(const Ray* rays, RayHit* hits, int64_t count) const {
+    parallelInit();
+    auto order = sortRaysForCoherence(rays, count);
+    auto nChunks = (count + RAY_STREAM_CHUNK_SIZE - 1) / RAY_STREAM_CHUNK_SIZE;
+
+    // stream rays rarely share a direction closely enough for packets to pay off,
+    // the sorted order alone keeps the working set of consecutive rays small
+    parallelFor1D([&](int64_t chunk) {
+        auto end = std::min(count, (chunk + 1) * RAY_STREAM_CHUNK_SIZE);
+        for (auto i = chunk * RAY_STREAM_CHUNK_SIZE; i < end; ++i) {
+            auto& ray = rays[order[i]];
+            auto& hit = hits[order[i]];
+            Ray r(ray);
+            Interaction isect;
+            auto found = intersect(r, isect);
+            hit.t = r.tMax;
+            hit.p = isect.p;
+            hit.n = isect.n;
+            hit.primitive = found ? isect.primitive : nullptr;
+        }
+    }, nChunks);
+
+    parallelCleanup();
+}
+
+void BVHAccel::occluded(const Ray* rays, std::uint32_t* occludedBits, int64_t count) const {
+    parallelInit();
+    auto order = sortRaysForCoherence(rays, count);
+    auto nChunks = (count + RAY_STREAM_CHUNK_SIZE - 1) / RAY_STREAM_CHUNK_SIZE;
+
+    // sorted rays scatter over the output words, keep one byte per ray until all are traced
+    std::vector<std::uint8_t> occluded(count);
+    parallelFor1D([&](int64_t chunk) {
+        auto end = std::min(count, (chunk + 1) * RAY_STREAM_CHUNK_SIZE);
+        for (auto i = chunk * RAY_STREAM_CHUNK_SIZE; i < end; ++i)
+            occluded[order[i]] = intersect(rays[order[i]]);
+    }, nChunks);
+
+    auto nWords = (count + 31) / 32;
+    parallelFor1D([&](int64_t word) {
+        std::uint32_t bits = 0;
+        auto end = std::min(count, (word + 1) * 32);
+        for (auto i = word * 32; i < end; ++i)
+            bits |= (std::uint32_t)occluded[i] << (i - word * 32);
+        occludedBits[word] = bits;
+    }, nWords, RAY_STREAM_CHUNK_SIZE);
+
+    parallelCleanup();
 }
 
 }
@@ -0,0 +1,203 @@
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <pt/core/aov.h>
+#include <pt/core/parallel.h>
+#include <pt/core/denoiser.h>
+
+namespace pt {
+
+static constexpr int BlockSize = 64;
+
+// B3 spline weights of the taps at 0, 1 and 2 steps from the center
+static const Float kernel[3] = { (Float)3 / 8, (Float)1 / 4, (Float)1 / 16 };
+
+// exp(-x) for x >= 0 approximated by (1 + x / 16)^-16, unlike a libm call it does not
+// keep the tap loops from being vectorized
+static inline Float expNegative(Float x) {
+    auto t = 1 / (1 + x * ((Float)1 / 16));
+    t *= t;
+    t *= t;
+    t *= t;
+    return t * t;
+}
+
+// every feature is a plane of its own so the loops over a row run over contiguous floats,
+// the planes have a border of invalid pixels as wide as the largest tap offset, taps
+// never need to be clamped
+enum Plane {
+    PlaneR, PlaneG, PlaneB, PlaneVariance,
+    PlaneNX, PlaneNY, PlaneNZ, PlaneNW, PlaneDepth,
+    PlaneAR, PlaneAG, PlaneAB, PlaneValid,
+    PlaneLuminance, PlaneSigma, PlaneWeight,
+    PlaneOutR, PlaneOutG, PlaneOutB, PlaneOutVariance,
+    PlaneCount
+};
+
+void denoise(const DenoiserInput& input, const DenoiserOptions& options) {
+    auto width = input.resolution.x;
+    auto height = input.resolution.y;
+    if (width <= 0 || height <= 0 || options.iterations <= 0) return;
+
+    auto border = 2 << (options.iterations - 1);
+    auto stride = (std::size_t)(width + 2 * border);
+    auto planeSize = stride * (height + 2 * border);
+    std::vector<Float> storage(planeSize * PlaneCount, 0);
+    Float* planes[PlaneCount];
+    for (auto i = 0; i < PlaneCount; ++i) planes[i] = &storage[planeSize * i];
+    auto index = [&](int x, int y) {
+        return (std::size_t)(y + border) * stride + (std::size_t)(x + border);
+    };
+
+    // the color is divided by the albedo, the filter then only blurs the illumination and
+    // texture detail comes back when multiplying again, emitters and black surfaces are
+    // not divided since the noise would be amplified, a missed pixel gets the fourth
+    // normal component so that misses only see each other, a broken sample would otherwise
+    // spread over the whole footprint
+    std::vector<Vector3> albedos(input.albedos, input.albedos + (std::size_t)width * height);
+    for (auto y = 0; y < height; ++y) {
+        for (auto x = 0; x < width; ++x) {
+            auto pixel = (std::size_t)y * width + x;
+            auto i = index(x, y);
+            auto& n = input.normals[pixel];
+            auto length = n.length();
+            auto hit = length > 0;
+            auto& albedo = albedos[pixel];
+            albedo = hit && luminance(albedo) > (Float)0.01 ? max(albedo, Vector3((Float)0.01)) : Vector3(1);
+            auto color = input.colors[pixel] * Vector3(1 / albedo.x, 1 / albedo.y, 1 / albedo.z);
+            if (!std::isfinite(color.x + color.y + color.z)) color = Vector3(0);
+            auto albedoLuminance = luminance(albedo);
+            planes[PlaneR][i] = color.x;
+            planes[PlaneG][i] = color.y;
+            planes[PlaneB][i] = color.z;
+            planes[PlaneVariance][i] = input.variances[pixel] / (albedoLuminance * albedoLuminance);
+            planes[PlaneNX][i] = hit ? n.x / length : 0;
+            planes[PlaneNY][i] = hit ? n.y / length : 0;
+            planes[PlaneNZ][i] = hit ? n.z / length : 0;
+            planes[PlaneNW][i] = hit ? 0 : 1;
+            planes[PlaneDepth][i] = input.depths[pixel];
+            planes[PlaneAR][i] = input.albedos[pixel].x;
+            planes[PlaneAG][i] = input.albedos[pixel].y;
+            planes[PlaneAB][i] = input.albedos[pixel].z;
+            planes[PlaneValid][i] = 1;
+        }
+    }
+
+    auto invSigmaAlbedo2 = 1 / (options.sigmaAlbedo * options.sigmaAlbedo);
+    parallelInit();
+    for (auto iteration = 0; iteration < options.iterations; ++iteration) {
+        auto step = 1 << iteration;
+
+        // the luminance weight is relative to the standard deviation of the center pixel,
+        // blurred over its 3x3 neighbours since a single pixel's estimate is noisy too
+        parallelFor1D([&](int64_t y) {
+            auto row = index(0, (int)y);
+            auto r = planes[PlaneR] + row, g = planes[PlaneG] + row, b = planes[PlaneB] + row;
+            auto lum = planes[PlaneLuminance] + row;
+            for (auto x = 0; x < width; ++x)
+                lum[x] = (Float)0.2126 * r[x] + (Float)0.7152 * g[x] + (Float)0.0722 * b[x];
+
+            auto sigma = planes[PlaneSigma] + row;
+            auto weights = planes[PlaneWeight] + row;
+            for (auto x = 0; x < width; ++x) sigma[x] = weights[x] = 0;
+            for (auto dy = -1; dy <= 1; ++dy) {
+                for (auto dx = -1; dx <= 1; ++dx) {
+                    auto h = (dx ? (Float)0.5 : 1) * (dy ? (Float)0.5 : 1);
+                    auto offset = (std::ptrdiff_t)row + dy * (std::ptrdiff_t)stride + dx;
+                    auto variance = planes[PlaneVariance] + offset;
+                    auto valid = planes[PlaneValid] + offset;
+                    for (auto x = 0; x < width; ++x) {
+                        sigma[x] += h * valid[x] * variance[x];
+                        weights[x] += h * valid[x];
+                    }
+                }
+            }
+            for (auto x = 0; x < width; ++x)
+                sigma[x] = options.sigmaLuminance * std::sqrt(sigma[x] / weights[x]) + (Float)1e-4;
+        }, height, 4);
+
+        parallelFor1D([&](int64_t y) {
+            auto row = index(0, (int)y);
+
+            // sums are kept in stack blocks, which the compiler knows do not alias the planes
+            for (auto x0 = 0; x0 < width; x0 += BlockSize) {
+                auto n = std::min(BlockSize, width - x0);
+                auto i0 = row + x0;
+                Float sumR[BlockSize], sumG[BlockSize], sumB[BlockSize], sumVariance[BlockSize], sumWeight[BlockSize];
+
+                // the center tap has every edge stopping term at zero
+                auto h = kernel[0] * kernel[0];
+                auto r = planes[PlaneR] + i0, g = planes[PlaneG] + i0, b = planes[PlaneB] + i0;
+                auto variance = planes[PlaneVariance] + i0;
+                for (auto x = 0; x < n; ++x) {
+                    sumR[x] = h * r[x];
+                    sumG[x] = h * g[x];
+                    sumB[x] = h * b[x];
+                    sumVariance[x] = h * h * variance[x];
+                    sumWeight[x] = h;
+                }
+
+                auto nx = planes[PlaneNX] + i0, ny = planes[PlaneNY] + i0, nz = planes[PlaneNZ] + i0;
+                auto nw = planes[PlaneNW] + i0, depth = planes[PlaneDepth] + i0;
+                auto ar = planes[PlaneAR] + i0, ag = planes[PlaneAG] + i0, ab = planes[PlaneAB] + i0;
+                auto lum = planes[PlaneLuminance] + i0, sigma = planes[PlaneSigma] + i0;
+                for (auto dy = -2; dy <= 2; ++dy) {
+                    for (auto dx = -2; dx <= 2; ++dx) {
+                        if (!dx && !dy) continue;
+                        h = kernel[std::abs(dx)] * kernel[std::abs(dy)];
+                        auto j0 = (std::ptrdiff_t)i0 + (dy * (std::ptrdiff_t)stride + dx) * step;
+                        auto tapR = planes[PlaneR] + j0, tapG = planes[PlaneG] + j0, tapB = planes[PlaneB] + j0;
+                        auto tapVariance = planes[PlaneVariance] + j0;
+                        auto tapNX = planes[PlaneNX] + j0, tapNY = planes[PlaneNY] + j0, tapNZ = planes[PlaneNZ] + j0;
+                        auto tapNW = planes[PlaneNW] + j0, tapDepth = planes[PlaneDepth] + j0;
+                        auto tapAR = planes[PlaneAR] + j0, tapAG = planes[PlaneAG] + j0, tapAB = planes[PlaneAB] + j0;
+                        auto tapLum = planes[PlaneLuminance] + j0, tapValid = planes[PlaneValid] + j0;
+                        auto depthScale = options.sigmaDepth * step * std::sqrt((Float)(dx * dx + dy * dy));
+
+                        for (auto x = 0; x < n; ++x) {
+                            auto normalDot = nx[x] * tapNX[x] + ny[x] * tapNY[x] + nz[x] * tapNZ[x] + nw[x] * tapNW[x];
+                            auto normalTerm = options.normalPower * std::max(1 - normalDot, (Float)0);
+                            auto depthTerm = std::abs(depth[x] - tapDepth[x]) / (depthScale * depth[x] + (Float)1e-6);
+                            auto luminanceTerm = std::abs(lum[x] - tapLum[x]) / sigma[x];
+                            auto dr = ar[x] - tapAR[x], dg = ag[x] - tapAG[x], db = ab[x] - tapAB[x];
+                            auto albedoTerm = (dr * dr + dg * dg + db * db) * invSigmaAlbedo2;
+
+                            auto w = h * tapValid[x] * expNegative(normalTerm + depthTerm + luminanceTerm + albedoTerm);
+                            sumR[x] += w * tapR[x];
+                            sumG[x] += w * tapG[x];
+                            sumB[x] += w * tapB[x];
+                            sumVariance[x] += w * w * tapVariance[x];
+                            sumWeight[x] += w;
+                        }
+                    }
+                }
+
+                auto outR = planes[PlaneOutR] + i0, outG = planes[PlaneOutG] + i0, outB = planes[PlaneOutB] + i0;
+                auto outVariance = planes[PlaneOutVariance] + i0;
+                for (auto x = 0; x < n; ++x) {
+                    auto invWeight = 1 / sumWeight[x];
+                    outR[x] = sumR[x] * invWeight;
+                    outG[x] = sumG[x] * invWeight;
+                    outB[x] = sumB[x] * invWeight;
+                    outVariance[x] = sumVariance[x] * invWeight * invWeight;
+                }
+            }
+        }, height, 4);
+
+        std::swap(planes[PlaneR], planes[PlaneOutR]);
+        std::swap(planes[PlaneG], planes[PlaneOutG]);
+        std::swap(planes[PlaneB], planes[PlaneOutB]);
+        std::swap(planes[PlaneVariance], planes[PlaneOutVariance]);
+    }
+    parallelCleanup();
+
+    for (auto y = 0; y < height; ++y) {
+        for (auto x = 0; x < width; ++x) {
+            auto pixel = (std::size_t)y * width + x;
+            auto i = index(x, y);
+            input.colors[pixel] = Vector3(planes[PlaneR][i], planes[PlaneG][i], planes[PlaneB][i]) * albedos[pixel];
+        }
+    }
+}
+
+}
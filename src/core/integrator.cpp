@@ -0,0 +1,246 @@
+#include <thread>
+#include <cstring>
+#include <sstream>
+#include <iostream>
+#include <typeinfo>
+#include <condition_variable>
+#include <pt/core/integrator.h>
+#include <pt/core/checkpoint.h>
+#include <pt/core/distributed.h>
+#include <pt/utils/socket.h>
+
+namespace pt {
+
+void SamplerIntegrator::removeCheckpoint() {
+    if (!checkpointFilename.empty()) pt::removeCheckpoint(checkpointFilename);
+}
+
+void SamplerIntegrator::render(const Scene& scene) {
+    PhaseTimer timer(PhaseRender);
+    RenderProgress progress { sampler.samplesPerPixel, getSamplesPerPass(), 0, sampler.seed, 0 };
+    if (!checkpointFilename.empty()) {
+        // streamed tiles are written once their first pass is merged
+        if (camera.film.isStreamed()) throw std::runtime_error("Streamed films can not be checkpointed!");
+        progress.identity = getCheckpointIdentity(scene);
+        RenderProgress saved;
+        if (readCheckpoint(checkpointFilename, camera.film, saved)) {
+            if (saved.samplesPerPixel != progress.samplesPerPixel || saved.samplesPerPass != progress.samplesPerPass)
+                throw std::runtime_error("Checkpoint was rendered with other sample counts: " + checkpointFilename);
+            if (saved.identity != progress.identity)
+                throw std::runtime_error("Checkpoint was rendered from another scene, camera or integrator: " +
+                                         checkpointFilename);
+            progress = saved;
+            sampler.seed = saved.seed;
+        }
+    }
+
+    parallelInit();
+#ifdef PT_TRAVERSAL_STATS
+    resetTraversalStats();
+#endif
+
+    TraversalHeatmap heatmap(camera.film.getSampleBounds());
+    auto nPasses = (progress.samplesPerPixel + progress.samplesPerPass - 1) / progress.samplesPerPass;
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    std::vector<double> tileCosts;
+    for (auto pass = progress.completedPasses; pass < nPasses; ++pass) {
+        auto passSamples = std::min(progress.samplesPerPass, progress.samplesPerPixel - pass * progress.samplesPerPass);
+        if (tileCosts.empty()) tileCosts = estimateTileCosts(scene);
+        tileCosts = renderPass(scene, pass, passSamples, tileCosts, heatmap);
+
+        progress.completedPasses = pass + 1;
+        if (checkpointFilename.empty()) continue;
+        auto now = std::chrono::steady_clock::now();
+        if (pass + 1 == nPasses || std::chrono::duration<double>(now - lastCheckpoint).count() >= checkpointInterval) {
+            writeCheckpoint(checkpointFilename, camera.film, progress);
+            lastCheckpoint = now;
+        }
+    }
+
+#ifdef PT_TRAVERSAL_STATS
+    reportTraversalStats(std::cout);
+    heatmap.writeImage(heatmapPrefix + ".png", camera.film.pixelBounds, camera.film.resolution);
+#endif
+    parallelCleanup();
+}
+
+void SamplerIntegrator::renderCoordinator(std::uint16_t port) {
+    PhaseTimer timer(PhaseRender);
+    auto nTiles = getTileCount(camera.film);
+    auto samplesPerPass = getSamplesPerPass();
+    auto nPasses = (sampler.samplesPerPixel + samplesPerPass - 1) / samplesPerPass;
+    std::deque<TileAssignment> pending;
+    for (auto pass = (std::int64_t)0; pass < nPasses; ++pass) {
+        auto passSamples = std::min(samplesPerPass, sampler.samplesPerPixel - pass * samplesPerPass);
+        for (auto& tile : getTileOrder(nTiles, tileOrder))
+            pending.push_back(TileAssignment { pass, passSamples, tile.x, tile.y });
+    }
+    auto nAssignments = pending.size();
+    std::size_t nMerged = 0;
+    std::mutex mutex;
+    std::condition_variable cv;
+    auto expectedHello = makeWorkerHello(camera.film);
+
+    // one thread per connection, each waits for its worker's tile and merges it
+    auto serve = [&](Socket socket) {
+        try {
+            auto hello = socket.recv<WorkerHello>();
+            if (std::memcmp(&hello, &expectedHello, sizeof(hello)) != 0)
+                throw std::runtime_error("Worker renders a different film!");
+            socket.send(CoordinatorHello { sampler.seed });
+
+            while (true) {
+                TileAssignment assignment;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&]() { return !pending.empty() || nMerged == nAssignments; });
+                    if (pending.empty()) break;
+                    assignment = pending.front();
+                    pending.pop_front();
+                }
+
+                try {
+                    socket.send(assignment);
+                    auto result = socket.recv<TileResult>();
+                    if (result.pass != assignment.pass || result.tileX != assignment.tileX || result.tileY != assignment.tileY)
+                        throw std::runtime_error("Worker sent another tile than it was assigned!");
+                    auto tileBounds = getTileBounds(camera.film, Vector2i(result.tileX, result.tileY));
+                    auto filmTile = camera.film.getFilmTile(tileBounds);
+                    std::string bytes(filmTile->getStateSize(), '\0');
+                    socket.recvAll(&bytes[0], bytes.size());
+                    std::istringstream in(bytes);
+                    filmTile->readState(in);
+                    camera.film.mergeFilmTile(std::move(filmTile));
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    pending.push_front(assignment);
+                    cv.notify_all();
+                    throw;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (++nMerged == nAssignments) cv.notify_all();
+            }
+            socket.send(TileAssignment { -1, 0, 0, 0 });
+        } catch (const std::exception& e) {
+            std::cerr << "Worker dropped: " << e.what() << std::endl;
+        }
+    };
+
+    auto listener = Socket::listen(port);
+    std::vector<std::thread> connections;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (nMerged == nAssignments) break;
+        }
+        auto socket = listener.accept(100);
+        if (socket.valid()) connections.emplace_back(serve, std::move(socket));
+    }
+    for (auto& connection : connections) connection.join();
+}
+
+void SamplerIntegrator::renderWorker(const Scene& scene, const std::string& host, std::uint16_t port) {
+    PhaseTimer timer(PhaseRender);
+#ifdef PT_TRAVERSAL_STATS
+    resetTraversalStats();
+#endif
+    auto hello = makeWorkerHello(camera.film);
+    auto connect = [&](int attempts, std::uint64_t& seed) {
+        for (auto attempt = 1;; ++attempt) {
+            try {
+                auto socket = Socket::connect(host, port);
+                socket.send(hello);
+                seed = socket.recv<CoordinatorHello>().seed;
+                return socket;
+            } catch (const std::runtime_error&) {
+                if (attempt == attempts) throw;
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+    };
+
+    // the coordinator queues every pass, so two connections may render the same tile of
+    // different passes at once, each has a heatmap of its own
+    auto nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<TraversalHeatmap> heatmaps(nThreads, TraversalHeatmap(camera.film.getSampleBounds()));
+    auto work = [&](const Socket& socket, TraversalHeatmap& heatmap) {
+        while (true) {
+            auto assignment = socket.recv<TileAssignment>();
+            if (assignment.passSamples <= 0) break;
+            auto tile = Vector2i(assignment.tileX, assignment.tileY);
+            auto filmTile = renderTile(scene, camera, assignment.pass, assignment.passSamples, tile, heatmap);
+            std::ostringstream out;
+            filmTile->writeState(out);
+            auto bytes = out.str();
+            socket.send(TileResult { assignment.pass, assignment.tileX, assignment.tileY });
+            socket.sendAll(bytes.data(), bytes.size());
+        }
+    };
+
+    // the first connection brings the seed, which the sampler takes before any tile
+    std::uint64_t seed;
+    auto socket = connect(100, seed);
+    sampler.seed = seed;
+
+    // the other connections only add threads, when one fails the coordinator hands its
+    // tile to another connection or it is already done
+    std::vector<std::thread> threads;
+    for (auto i = 1u; i < nThreads; ++i) {
+        threads.emplace_back([&, i]() {
+            try {
+                std::uint64_t unused;
+                work(connect(1, unused), heatmaps[i]);
+            } catch (const std::runtime_error&) { }
+        });
+    }
+    try {
+        work(socket, heatmaps[0]);
+    } catch (...) {
+        for (auto& thread : threads) thread.join();
+        throw;
+    }
+    for (auto& thread : threads) thread.join();
+
+#ifdef PT_TRAVERSAL_STATS
+    // the costs of the tiles this worker rendered, the others stay at 0
+    for (auto i = 1u; i < nThreads; ++i) heatmaps[0].merge(heatmaps[i]);
+    reportTraversalStats(std::cout);
+    heatmaps[0].writeImage(heatmapPrefix + ".png", camera.film.pixelBounds, camera.film.resolution);
+#endif
+}
+
+std::uint64_t SamplerIntegrator::getCheckpointIdentity(const Scene& scene) const {
+    auto name = typeid(*this).name();
+    auto hash = hashBytes(name, std::strlen(name));
+    auto add = [&](const Vector3& v) {
+        Float values[3] = { v.x, v.y, v.z };
+        hash = hashBytes(values, sizeof(values), hash);
+    };
+    auto settings = getSettingsHash();
+    hash = hashBytes(&settings, sizeof(settings), hash);
+    auto bounds = scene.accel.worldBound();
+    add(bounds.pMin);
+    add(bounds.pMax);
+    auto nLights = (std::uint64_t)scene.lights.size();
+    hash = hashBytes(&nLights, sizeof(nLights), hash);
+
+    auto resolution = (Vector2f)camera.film.resolution;
+    for (auto y = 0; y < 16; ++y) {
+        for (auto x = 0; x < 16; ++x) {
+            CameraSample sample { Vector2f((x + (Float)0.5) / 16 * resolution.x, (y + (Float)0.5) / 16 * resolution.y),
+                                  Vector2f(0.5) };
+            auto ray = camera.generateRay(sample);
+            add(ray.o);
+            add(ray.d);
+            Interaction isect;
+            if (scene.intersect(ray, isect)) {
+                add(isect.p);
+                add(isect.n);
+            }
+        }
+    }
+    return hash;
+}
+
+}
@@ -3,16 +3,20 @@
 #include <mutex>
 #include <condition_variable>
 #include <pt/core/parallel.h>
+#include <pt/core/tileorder.h>
+#include <pt/core/trace.h>
 
 namespace pt {
 
 class ParallelForLoop;
 
 static std::vector<std::thread> threads;
+static auto initCount = 0;
 static auto shutdownThreads = false;
 static ParallelForLoop* workList = nullptr;
 static std::mutex m;
 static std::condition_variable cv;
+static thread_local int threadIndex = -1;
 
 class ParallelForLoop {
 public:
@@ -20,8 +24,9 @@ public:
         : func1D(std::move(func1D)), count(count), chunkSize(chunkSize)
     { }
 
-    ParallelForLoop(std::function<void(const Vector2i&)>&& func2D, const Vector2i& count) noexcept
-        : func2D(std::move(func2D)), count(count.x * count.y), countX(count.x), chunkSize(1)
+    ParallelForLoop(std::function<void(const Vector2i&)>&& func2D, const Vector2i& count, int chunkSize)
+        : func2D(std::move(func2D)), count(count.x * count.y), order(getTileOrder(count, TileOrder::Hilbert))
+        , chunkSize(chunkSize)
     { }
 
     bool isFinish() const {
@@ -33,17 +38,20 @@ public:
     std::function<void(const Vector2i&)> func2D;
     int64_t count;
     int64_t nextIndex = 0;
-    int countX;
+    std::vector<Vector2i> order;
     int chunkSize;
     int activeThreads = 0;
     ParallelForLoop* next = nullptr;
 };
 
-void workerThreadFunc() {
+void workerThreadFunc(int index) {
+    threadIndex = index;
     std::unique_lock<std::mutex> lock(m);
     while (!shutdownThreads) {
-        if (!workList) cv.wait(lock);
-        else {
+        if (!workList) {
+            TraceScope scope("idle", "pool");
+            cv.wait(lock);
+        } else {
             auto& loop = *workList;
             auto beg = loop.nextIndex;
             auto end = std::min(loop.nextIndex + loop.chunkSize, loop.count);
@@ -56,21 +64,25 @@ void workerThreadFunc() {
             if (loop.func1D)
                 for (auto i = beg; i < end; ++i) loop.func1D(i);
             else
-                loop.func2D(Vector2i(beg % loop.countX, beg / loop.countX));
+                for (auto i = beg; i < end; ++i) loop.func2D(loop.order[i]);
 
-            lock.lock();
+            lockTraced(lock, "work queue");
             --loop.activeThreads;
         }
     }
 }
 
 void parallelInit() {
+    if (initCount++) return;
+    threadIndex = 0;
     int maxThreads = std::max(std::thread::hardware_concurrency(), 1u) - 1;
     for (auto i = 0; i < maxThreads; ++i)
-        threads.emplace_back(workerThreadFunc);
+        threads.emplace_back(workerThreadFunc, i + 1);
 }
 
 void parallelCleanup() {
+    if (--initCount) return;
+
     {
         std::lock_guard<std::mutex> guard(m);
         shutdownThreads = true;
@@ -82,6 +94,15 @@ void parallelCleanup() {
     threads.clear();
 
     shutdownThreads = false;
+    threadIndex = -1;
+}
+
+int parallelThreadCount() {
+    return (int)threads.size() + 1;
+}
+
+int parallelThreadIndex() {
+    return threadIndex;
 }
 
 void parallelFor1D(std::function<void(int64_t)> func, int64_t count, int chunkSize) {
@@ -92,7 +113,8 @@ void parallelFor1D(std::function<void(int64_t)> func, int64_t count, int chunkSi
 
     ParallelForLoop loop(std::move(func), count, chunkSize);
 
-    std::unique_lock<std::mutex> lock(m);
+    std::unique_lock<std::mutex> lock(m, std::defer_lock);
+    lockTraced(lock, "work queue");
     workList = &loop;
     cv.notify_all();
 
@@ -104,22 +126,26 @@ void parallelFor1D(std::function<void(int64_t)> func, int64_t count, int chunkSi
         ++loop.activeThreads;
         lock.unlock();
         for (auto i = beg; i < end; ++i) loop.func1D(i);
-        lock.lock();
+        // once every index is handed out the caller spins here until the workers are done,
+        // only the waits after work are traced
+        if (beg < end) lockTraced(lock, "work queue");
+        else lock.lock();
         --loop.activeThreads;
     }
 }
 
-void parallelFor2D(std::function<void(const Vector2i&)> func, const Vector2i& count) {
+void parallelFor2D(std::function<void(const Vector2i&)> func, const Vector2i& count, int chunkSize) {
     if (count.x * count.y == 0) return;
 
-    if (threads.empty() || count.x * count.y == 1) {
-        func(Vector2i(0, 0));
+    if (threads.empty() || count.x * count.y <= chunkSize) {
+        for (auto& p : getTileOrder(count, TileOrder::Hilbert)) func(p);
         return;
     }
 
-    ParallelForLoop loop(std::move(func), count);
+    ParallelForLoop loop(std::move(func), count, chunkSize);
 
-    std::unique_lock<std::mutex> lock(m);
+    std::unique_lock<std::mutex> lock(m, std::defer_lock);
+    lockTraced(lock, "work queue");
     workList = &loop;
     cv.notify_all();
 
@@ -129,13 +155,13 @@ void parallelFor2D(std::function<void(const Vector2i&)> func, const Vector2i& co
             lock.lock();
         } else {
             auto beg = loop.nextIndex;
-            auto end = std::min(loop.nextIndex + 1, loop.count);
+            auto end = std::min(loop.nextIndex + chunkSize, loop.count);
             loop.nextIndex = end;
             if (loop.nextIndex == loop.count) workList = loop.next;
             ++loop.activeThreads;
             lock.unlock();
-            loop.func2D(Vector2i(beg % loop.countX, beg / loop.countX));
-            lock.lock();
+            for (auto i = beg; i < end; ++i) loop.func2D(loop.order[i]);
+            lockTraced(lock, "work queue");
             --loop.activeThreads;
         }
     }
@@ -0,0 +1,299 @@
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <sys/resource.h>
+#include <pt/core/stats.h>
+#include <pt/core/trace.h>
+#include <pt/core/parallel.h>
+#include <pt/utils/imageio.h>
+
+namespace pt {
+
+void TraversalCounters::merge(const TraversalCounters& counters) {
+    rays += counters.rays;
+    hits += counters.hits;
+    nodesVisited += counters.nodesVisited;
+    boxesTested += counters.boxesTested;
+    primsTested += counters.primsTested;
+    maxNodesVisited = std::max(maxNodesVisited, counters.maxNodesVisited);
+    maxPrimsTested = std::max(maxPrimsTested, counters.maxPrimsTested);
+    for (auto i = 0; i < TraversalHistogramBuckets; ++i) {
+        nodesHistogram[i] += counters.nodesHistogram[i];
+        primsHistogram[i] += counters.primsHistogram[i];
+    }
+}
+
+struct ThreadRenderCounters {
+    std::uint64_t counts[RenderCounterCount] = {};
+};
+
+// one slot per pool thread index rather than per OS thread, worker threads exit before the
+// stats are read and every render starts new ones, which take up the slots of the old ones
+static PerThread<ThreadRenderCounters> threadRenderCounters;
+static std::atomic<std::uint64_t> sharedRenderCounts[RenderCounterCount];
+static std::atomic<std::int64_t> phaseNanoseconds[RenderPhaseCount];
+
+static const char* phaseNames[RenderPhaseCount] = { "load", "build", "render", "denoise", "write" };
+
+std::uint64_t* getThreadRenderCounters() {
+    auto counters = threadRenderCounters.get();
+    return counters ? counters->counts : nullptr;
+}
+
+void addSharedRenderCount(RenderCounter counter, std::uint64_t n) {
+    sharedRenderCounts[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+PhaseTimer::~PhaseTimer() {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    phaseNanoseconds[phase] += elapsed.count();
+    if (isTracing()) recordTraceEvent(phaseNames[phase], "phase", getTraceTime(start));
+}
+
+void resetRenderStats() {
+    threadRenderCounters.forEach([](ThreadRenderCounters& counters) { counters = ThreadRenderCounters(); });
+    for (auto& count : sharedRenderCounts) count = 0;
+    for (auto& nanoseconds : phaseNanoseconds) nanoseconds = 0;
+}
+
+struct RenderStats {
+    double seconds[RenderPhaseCount];
+    std::uint64_t counts[RenderCounterCount] = {};
+    std::uint64_t rays;
+    double mraysPerSecond;
+    double averagePathLength;
+    double rouletteRate;
+    std::uint64_t peakRSS;
+};
+
+static RenderStats gatherRenderStats() {
+    RenderStats stats;
+    threadRenderCounters.forEach([&](const ThreadRenderCounters& counters) {
+        for (auto i = 0; i < RenderCounterCount; ++i) stats.counts[i] += counters.counts[i];
+    });
+    for (auto i = 0; i < RenderCounterCount; ++i) stats.counts[i] += sharedRenderCounts[i];
+    for (auto i = 0; i < RenderPhaseCount; ++i) stats.seconds[i] = phaseNanoseconds[i] * 1e-9;
+    stats.rays = stats.counts[CameraRays] + stats.counts[IndirectRays] + stats.counts[ShadowRays];
+    stats.mraysPerSecond = stats.seconds[PhaseRender] > 0 ? stats.rays * 1e-6 / stats.seconds[PhaseRender] : 0;
+    auto paths = (double)stats.counts[Paths];
+    stats.averagePathLength = paths > 0 ? stats.counts[PathVertices] / paths : 0;
+    stats.rouletteRate = paths > 0 ? stats.counts[RussianRouletteTerminations] / paths : 0;
+
+    // kilobytes on Linux
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    stats.peakRSS = (std::uint64_t)usage.ru_maxrss * 1024;
+    return stats;
+}
+
+void reportRenderStats(std::ostream& os) {
+    auto stats = gatherRenderStats();
+    auto flags = os.flags();
+    auto precision = os.precision();
+    os << std::fixed << std::setprecision(2) << "Render statistics:\n";
+    for (auto i = 0; i < RenderPhaseCount; ++i)
+        os << "  " << std::left << std::setw(17) << phaseNames[i] << std::right << stats.seconds[i] << " s\n";
+    os << "  camera rays      " << stats.counts[CameraRays] << "\n"
+       << "  indirect rays    " << stats.counts[IndirectRays] << "\n"
+       << "  shadow rays      " << stats.counts[ShadowRays] << "\n"
+       << "  throughput       " << stats.mraysPerSecond << " Mrays/s\n"
+       << "  path length      " << stats.averagePathLength << " vertices avg\n"
+       << "  roulette         " << stats.rouletteRate * 100 << "% of paths ended\n"
+       << "  peak RSS         " << stats.peakRSS / (1024.0 * 1024.0) << " MB\n";
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void writeRenderStats(const std::string& filename) {
+    auto stats = gatherRenderStats();
+    std::ofstream file(filename);
+    if (!file) throw std::runtime_error("Unable to create file: " + filename);
+    file << std::setprecision(9) << "{\n  \"seconds\": {";
+    for (auto i = 0; i < RenderPhaseCount; ++i)
+        file << (i ? ", " : " ") << "\"" << phaseNames[i] << "\": " << stats.seconds[i];
+    file << " },\n"
+         << "  \"rays\": { \"camera\": " << stats.counts[CameraRays]
+         << ", \"indirect\": " << stats.counts[IndirectRays]
+         << ", \"shadow\": " << stats.counts[ShadowRays]
+         << ", \"total\": " << stats.rays << " },\n"
+         << "  \"mraysPerSecond\": " << stats.mraysPerSecond << ",\n"
+         << "  \"paths\": " << stats.counts[Paths] << ",\n"
+         << "  \"averagePathLength\": " << stats.averagePathLength << ",\n"
+         << "  \"russianRouletteRate\": " << stats.rouletteRate << ",\n"
+         << "  \"peakRSSBytes\": " << stats.peakRSS << "\n"
+         << "}\n";
+    if (!file) throw std::runtime_error("Unable to write file: " + filename);
+}
+
+#ifdef PT_TRAVERSAL_STATS
+
+struct ThreadTraversalStats {
+    TraversalCounters counters[RayTypeCount];
+    std::uint64_t cost = 0;
+};
+
+// owned here rather than by the threads, worker threads exit before the stats are merged,
+// pool threads count into the slot of their index, other threads take spare stats and give
+// them back when they exit
+static PerThread<ThreadTraversalStats> poolThreadStats;
+static std::mutex statsMutex;
+static std::vector<std::unique_ptr<ThreadTraversalStats>> otherThreadStats;
+static std::vector<ThreadTraversalStats*> spareThreadStats;
+
+struct ThreadStatsLease {
+    ~ThreadStatsLease() {
+        if (!stats) return;
+        std::lock_guard<std::mutex> lock(statsMutex);
+        spareThreadStats.push_back(stats);
+    }
+
+    ThreadTraversalStats* stats = nullptr;
+};
+
+static ThreadTraversalStats& threadStats() {
+    if (auto stats = poolThreadStats.get()) return *stats;
+    thread_local ThreadStatsLease lease;
+    if (!lease.stats) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        if (spareThreadStats.empty()) {
+            otherThreadStats.emplace_back(new ThreadTraversalStats());
+            lease.stats = otherThreadStats.back().get();
+        } else {
+            lease.stats = spareThreadStats.back();
+            spareThreadStats.pop_back();
+        }
+    }
+    return *lease.stats;
+}
+
+static int histogramBucket(std::uint64_t n) {
+    auto bucket = 0;
+    while (bucket < TraversalHistogramBuckets - 1 && ((n + 1) >> (bucket + 1)))
+        ++bucket;
+    return bucket;
+}
+
+void RayStats::record(RayType type, bool hit) const {
+    auto& stats = threadStats();
+    auto& counters = stats.counters[type];
+    ++counters.rays;
+    counters.hits += hit;
+    counters.nodesVisited += nodesVisited;
+    counters.boxesTested += boxesTested;
+    counters.primsTested += primsTested;
+    counters.maxNodesVisited = std::max(counters.maxNodesVisited, (std::uint64_t)nodesVisited);
+    counters.maxPrimsTested = std::max(counters.maxPrimsTested, (std::uint64_t)primsTested);
+    ++counters.nodesHistogram[histogramBucket(nodesVisited)];
+    ++counters.primsHistogram[histogramBucket(primsTested)];
+    stats.cost += nodesVisited + primsTested;
+}
+
+std::uint64_t threadTraversalCost() {
+    return threadStats().cost;
+}
+
+TraversalCounters mergeTraversalStats(RayType type) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    TraversalCounters merged;
+    poolThreadStats.forEach([&](const ThreadTraversalStats& stats) { merged.merge(stats.counters[type]); });
+    for (auto& stats : otherThreadStats)
+        merged.merge(stats->counters[type]);
+    return merged;
+}
+
+void resetTraversalStats() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    poolThreadStats.forEach([](ThreadTraversalStats& stats) { stats = ThreadTraversalStats(); });
+    for (auto& stats : otherThreadStats)
+        *stats = ThreadTraversalStats();
+}
+
+TraversalHeatmap::TraversalHeatmap(const Bounds2i& sampleBounds)
+    : sampleBounds(sampleBounds)
+    , costs(sampleBounds.area())
+    , samples(sampleBounds.area())
+{ }
+
+std::uint64_t TraversalHeatmap::threadCost() const {
+    return threadTraversalCost();
+}
+
+void TraversalHeatmap::merge(const TraversalHeatmap& heatmap) {
+    for (std::size_t i = 0; i < costs.size(); ++i) {
+        costs[i] += heatmap.costs[i];
+        samples[i] += heatmap.samples[i];
+    }
+}
+
+void TraversalHeatmap::writeImage(
+    const std::string& filename, const Bounds2i& pixelBounds, const Vector2i& resolution) const {
+
+    std::vector<Float> averages;
+    averages.reserve(pixelBounds.area());
+    // the pixels of a shard reach past its samples, those pixels are left at 0
+    for (auto p : pixelBounds) {
+        if (!insideExclusive(p, sampleBounds)) {
+            averages.push_back(0);
+            continue;
+        }
+        auto offset = (p.x - sampleBounds.pMin.x) + (p.y - sampleBounds.pMin.y) * sampleBounds.diag().x;
+        averages.push_back(samples[offset] ? (Float)costs[offset] / samples[offset] : 0);
+    }
+    auto maxAverage = std::max(*std::max_element(averages.begin(), averages.end()), (Float)1);
+
+    std::unique_ptr<Float[]> rgbs(new Float[3 * averages.size()]);
+    for (std::size_t i = 0; i < averages.size(); ++i) {
+        auto t = averages[i] / maxAverage;
+        rgbs[3 * i + 0] = std::clamp(2 * t - 1, (Float)0, (Float)1);
+        rgbs[3 * i + 1] = 1 - std::abs(2 * t - 1);
+        rgbs[3 * i + 2] = std::clamp(1 - 2 * t, (Float)0, (Float)1);
+    }
+    pt::writeImage(filename, &rgbs[0], pixelBounds, resolution);
+}
+
+static void reportHistogram(std::ostream& os, const char* name, const std::uint64_t* histogram, std::uint64_t rays) {
+    auto last = TraversalHistogramBuckets - 1;
+    while (last > 0 && !histogram[last]) --last;
+    os << "  " << name << " per ray:\n";
+    for (auto i = 0; i <= last; ++i) {
+        auto lo = (std::uint64_t(1) << i) - 1;
+        auto hi = (std::uint64_t(1) << (i + 1)) - 1;
+        auto fraction = (double)histogram[i] / rays;
+        os << "    [" << std::setw(5) << lo << ", ";
+        if (i == TraversalHistogramBuckets - 1) os << std::setw(6) << "inf) ";
+        else os << std::setw(5) << hi << ") ";
+        os << std::setw(6) << std::fixed << std::setprecision(2) << fraction * 100 << "% "
+           << std::string((std::size_t)(fraction * 50 + 0.5), '#') << "\n";
+    }
+}
+
+void reportTraversalStats(std::ostream& os) {
+    const char* names[RayTypeCount] = { "closest hit", "shadow" };
+    auto flags = os.flags();
+    auto precision = os.precision();
+    for (auto type = 0; type < RayTypeCount; ++type) {
+        auto counters = mergeTraversalStats((RayType)type);
+        if (!counters.rays) continue;
+        auto rays = (double)counters.rays;
+        os << std::fixed << std::setprecision(2)
+           << "BVH traversal, " << names[type] << " rays: " << counters.rays << "\n"
+           << "  hit rate         " << counters.hits / rays * 100 << "%\n"
+           << "  nodes visited    " << counters.nodesVisited / rays << " avg, " << counters.maxNodesVisited << " max\n"
+           << "  boxes tested     " << counters.boxesTested / rays << " avg\n"
+           << "  prims tested     " << counters.primsTested / rays << " avg, " << counters.maxPrimsTested << " max\n";
+        reportHistogram(os, "nodes visited", counters.nodesHistogram, counters.rays);
+        reportHistogram(os, "prims tested", counters.primsHistogram, counters.rays);
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
+
+#endif
+
+}
@@ -0,0 +1,117 @@
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <pt/core/trace.h>
+#include <pt/core/parallel.h>
+
+namespace pt {
+
+std::atomic<bool> traceEnabled(false);
+
+// owned here rather than by the threads, threads may exit before the trace is written,
+// the ring is allocated by the thread's first event
+struct ThreadTraceBuffer {
+    std::vector<TraceEvent> events;
+    std::uint64_t count = 0;
+};
+
+// pool threads write to the buffer of their index, which the threads of later pools take
+// up, other threads take a spare buffer and give it back when they exit, so there are never
+// more buffers than threads running at once
+static PerThread<ThreadTraceBuffer> poolTraceBuffers;
+static std::mutex traceMutex;
+static std::vector<std::unique_ptr<ThreadTraceBuffer>> otherTraceBuffers;
+static std::vector<ThreadTraceBuffer*> spareTraceBuffers;
+static std::chrono::steady_clock::time_point traceOrigin = std::chrono::steady_clock::now();
+
+struct TraceBufferLease {
+    ~TraceBufferLease() {
+        if (!buffer) return;
+        std::lock_guard<std::mutex> lock(traceMutex);
+        spareTraceBuffers.push_back(buffer);
+    }
+
+    ThreadTraceBuffer* buffer = nullptr;
+};
+
+static ThreadTraceBuffer& threadTraceBuffer() {
+    if (auto buffer = poolTraceBuffers.get()) return *buffer;
+    thread_local TraceBufferLease lease;
+    if (!lease.buffer) {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        if (spareTraceBuffers.empty()) {
+            otherTraceBuffers.emplace_back(new ThreadTraceBuffer());
+            lease.buffer = otherTraceBuffers.back().get();
+        } else {
+            lease.buffer = spareTraceBuffers.back();
+            spareTraceBuffers.pop_back();
+        }
+    }
+    return *lease.buffer;
+}
+
+void startTrace() {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    poolTraceBuffers.forEach([](ThreadTraceBuffer& buffer) { buffer.count = 0; });
+    for (auto& buffer : otherTraceBuffers) buffer->count = 0;
+    traceOrigin = std::chrono::steady_clock::now();
+    traceEnabled = true;
+}
+
+void stopTrace() {
+    traceEnabled = false;
+}
+
+std::int64_t getTraceTime(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - traceOrigin).count();
+}
+
+void recordTraceEvent(const char* name, const char* category, std::int64_t start,
+                      const char* argName, std::int64_t arg) {
+    auto end = getTraceTime(std::chrono::steady_clock::now());
+    auto& buffer = threadTraceBuffer();
+    if (buffer.events.empty()) buffer.events.resize(TraceBufferEvents);
+    buffer.events[buffer.count++ % TraceBufferEvents] = TraceEvent { name, category, argName, arg, start, end - start };
+}
+
+void writeTrace(const std::string& filename) {
+    std::ofstream file(filename);
+    if (!file) throw std::runtime_error("Unable to create file: " + filename);
+
+    // timestamps are in microseconds, every buffer is a track of process 1, the tracks of
+    // pool threads are named after their index, the others after their buffer
+    std::lock_guard<std::mutex> lock(traceMutex);
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+    auto first = true;
+    auto tid = 0;
+    auto writeBuffer = [&](const ThreadTraceBuffer& buffer, const std::string& name) {
+        if (buffer.count) {
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+                 << ",\"args\":{\"name\":\"" << name << "\"}}";
+            first = false;
+
+            auto begin = buffer.count > (std::uint64_t)TraceBufferEvents ? buffer.count - TraceBufferEvents : 0;
+            for (auto i = begin; i < buffer.count; ++i) {
+                auto& event = buffer.events[i % TraceBufferEvents];
+                file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+                     << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+                     << ",\"ts\":" << event.start * 1e-3 << ",\"dur\":" << event.duration * 1e-3;
+                if (event.argName) file << ",\"args\":{\"" << event.argName << "\":" << event.arg << "}";
+                file << "}";
+            }
+        }
+        ++tid;
+    };
+    poolTraceBuffers.forEach([&](const ThreadTraceBuffer& buffer) {
+        writeBuffer(buffer, tid ? "worker " + std::to_string(tid) : "main");
+    });
+    for (std::size_t i = 0; i < otherTraceBuffers.size(); ++i)
+        writeBuffer(*otherTraceBuffers[i], "thread " + std::to_string(i));
+    file << "\n]}\n";
+    if (!file) throw std::runtime_error("Unable to write file: " + filename);
+}
+
+}
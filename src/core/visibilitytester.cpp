@@ -1,4 +1,5 @@
 #include <pt/core/scene.h>
+#include <pt/core/stats.h>
 #include <pt/core/visibilitytester.h>
 
 namespace pt {
@@ -6,6 +7,7 @@ namespace pt {
 // Scene class's dependency is too much
 // implement this simple method in cpp file to avoid circular dependency 
 bool VisibilityTester::unoccluded(const Scene& scene) const {
+    addRenderCount(ShadowRays);
     return !scene.intersect(ref->spawnRayTo(target));
 }
 
@@ -1,4 +1,5 @@
 #include <pt/core/bsdf.h>
+#include <pt/core/stats.h>
 #include <pt/core/light.h>
 #include <pt/core/interaction.h>
 #include <pt/core/visibilitytester.h>
@@ -6,15 +7,39 @@
 
 namespace pt {
 
-Vector3 PathIntegrator::li(const Ray& ray, const Scene& scene) const {
+Vector3 PathIntegrator::li(const Ray& ray, const Scene& scene, Sampler& sampler) const {
+    Interaction isect;
+    auto foundIntersection = scene.intersect(ray, isect);
+    return li(ray, scene, sampler, isect, foundIntersection);
+}
+
+Vector3 PathIntegrator::li(
+    const Ray& ray, const Scene& scene, Sampler& sampler,
+    Interaction& isect, bool foundIntersection) const {
+    AOVSample aovs;
+    return li(ray, scene, sampler, isect, foundIntersection, aovs);
+}
+
+Vector3 PathIntegrator::li(
+    const Ray& ray, const Scene& scene, Sampler& sampler,
+    Interaction& cameraIsect, bool foundCameraIntersection, AOVSample& aovs) const {
+
+    aovs.setGeometry(ray, cameraIsect, foundCameraIntersection);
+    // direct is the radiance gathered at the first hit
+    Vector3 direct(0);
+    auto directDone = false;
+
     Ray r(ray);
     auto etaScaleFix = (Float)1;
     auto specularBounce = false;
     Vector3 l(0), beta(1), rrBeta(1);
+    auto vertices = 0;
 
     for (auto bounce = 0; bounce < maxDepth; ++bounce) {
-        Interaction isect;
-        auto foundIntersection = scene.intersect(r, isect);
+        Interaction bounceIsect;
+        auto& isect = bounce == 0 ? cameraIsect : bounceIsect;
+        if (bounce > 0) addRenderCount(IndirectRays);
+        auto foundIntersection = bounce == 0 ? foundCameraIntersection : scene.intersect(r, isect);
 
         if (bounce == 0 || specularBounce) {
             if (foundIntersection) {
@@ -25,14 +50,23 @@ Vector3 PathIntegrator::li(const Ray& ray, const Scene& scene) const {
         }
 
         if (!foundIntersection) break;
+        ++vertices;
         isect.computeScatteringFunctions();
         if (!isect.bsdf) break;
-        l += beta * sampleOneLight(isect, scene);
+        l += beta * sampleOneLight(isect, scene, sampler);
+        if (bounce == 0) {
+            direct = l;
+            directDone = true;
+        }
 
         Float pdf, etaScale;
         Vector3 wi, wo = -r.d;
         auto f = isect.bsdf->sampleF(sampler.get2D(), wo, wi, pdf, etaScale);
 
+        // a single sample estimate of the reflectance, averaged over the pixel samples
+        if (bounce == 0 && aovs.wants(AOVAlbedo) && !f.isBlack())
+            aovs.set(AOVAlbedo, f * absdot(isect.n, wi) / pdf);
+
         if (f.isBlack()) break;
         if (isect.bsdf->isDelta()) specularBounce = true;
 
@@ -43,18 +77,30 @@ Vector3 PathIntegrator::li(const Ray& ray, const Scene& scene) const {
         r = isect.spawnRay(wi);
         if (rrBeta.maxComponent() < 1 && bounce > 3) {
             auto q = std::max((Float)0.05, 1 - rrBeta.maxComponent());
-            if (sampler.get1D() < q) break;
+            if (sampler.get1D() < q) {
+                addRenderCount(RussianRouletteTerminations);
+                break;
+            }
             beta /= 1 - q;
         }
     }
 
+    addRenderCount(Paths);
+    addRenderCount(PathVertices, vertices);
+
+    if (aovs.enabled) {
+        if (!directDone) direct = l;
+        aovs.set(AOVDirect, direct);
+        aovs.set(AOVIndirect, l - direct);
+    }
     return l;
 }
 
 Vector3 PathIntegrator::estimateDirect(
     const Interaction& isect,
     const Light& light,
-    const Scene& scene) const {
+    const Scene& scene,
+    Sampler& sampler) const {
 
     Vector3 wi;
     Float lightPdf;
@@ -87,6 +133,7 @@ Vector3 PathIntegrator::estimateDirect(
             if (lightPdf == 0) return ld;
             Interaction lightIsect;
             auto ray = isect.spawnRay(wi);
+            addRenderCount(IndirectRays);
             auto foundIntersection = scene.intersect(ray, lightIsect);
             Vector3 li(0);
             if (foundIntersection) {
@@ -1,3 +1,5 @@
+#include <stdexcept>
+#include <sys/stat.h>
 #include <pt/core/scene.h>
 #include <pt/core/integrator.h>
 #include <pt/samplers/random.h>
@@ -5,6 +7,7 @@
 #include <pt/accelerators/bvh.h>
 #include <pt/shapes/triangle.h>
 #include <pt/utils/objloader.h>
+#include <pt/utils/ptmloader.h>
 #include <pt/filters/box.h>
 
 using namespace pt;
@@ -16,7 +19,7 @@ public:
         : SamplerIntegrator(camera, sampler)
     { }
 
-    Vector3 li(const Ray& ray, const Scene& scene) const override {
+    Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler) const override {
         Interaction isect;
         if (scene.intersect(ray, isect))
             return abs(isect.n);
@@ -24,8 +27,19 @@ public:
     }
 };
 
+// converts the OBJ to bunny.ptm in the working directory, the build directory, later runs
+// map it and borrow its streams, it is converted again once bunny.obj is newer than it
+static Mesh loadBunny() {
+    struct stat obj, ptm;
+    if (stat("../assets/bunny.obj", &obj) != 0)
+        throw std::runtime_error("Unable to open file: ../assets/bunny.obj");
+    if (stat("./bunny.ptm", &ptm) != 0 || ptm.st_mtime < obj.st_mtime)
+        writePtmMesh("./bunny.ptm", loadObjMesh("../assets/bunny.obj"));
+    return loadPtmMesh("./bunny.ptm");
+}
+
 int main() {
-    auto bunny = loadObjMesh("../assets/bunny.obj");
+    auto bunny = loadBunny();
     auto triangles = createTriangleMesh(bunny);
     std::vector<Primitive*> primitives;
 
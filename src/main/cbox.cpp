@@ -1,12 +1,13 @@
-#include <pt/utils/objloader.h>
+#include <string>
+#include <iostream>
 #include <pt/core/scene.h>
-#include <pt/materials/matte.h>
-#include <pt/lights/diffuse.h>
+#include <pt/core/trace.h>
 #include <pt/accelerators/bvh.h>
 #include <pt/cameras/perspective.h>
 #include <pt/samplers/random.h>
 #include <pt/integrators/path.h>
 #include <pt/filters/box.h>
+#include "cboxscene.h"
 
 using namespace pt;
 
@@ -16,7 +17,7 @@ public:
         : SamplerIntegrator(camera, sampler)
     { }
 
-    Vector3 li(const Ray& ray, const Scene& scene) const override {
+    Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler) const override {
         Interaction isect;
         if (scene.intersect(ray, isect))
             return max(isect.n, Vector3(0));
@@ -24,56 +25,36 @@ public:
     }
 };
 
-int main() {
-    std::vector<Primitive*> prims;
-    std::vector<std::shared_ptr<Light>> lights;
-
-    auto walls = loadObjMesh("../assets/walls.obj");
-    auto triangles = createTriangleMesh(walls);
-    auto wallMaterial = std::make_shared<MatteMaterial>(Vector3(0.725, 0.71, 0.68));
-    for (auto& triangle : triangles)
-        prims.push_back(new GeometricPrimitive(triangle, wallMaterial));
-
-    auto rightWall = loadObjMesh("../assets/rightwall.obj");
-    triangles = createTriangleMesh(rightWall);
-    auto rightWallMaterial = std::make_shared<MatteMaterial>(Vector3(0.161, 0.133, 0.427));
-    for (auto& triangle : triangles)
-        prims.push_back(new GeometricPrimitive(triangle, rightWallMaterial));
-
-    auto leftWall = loadObjMesh("../assets/leftwall.obj");
-    triangles = createTriangleMesh(leftWall);
-    auto leftWallMaterial = std::make_shared<MatteMaterial>(Vector3(0.630, 0.065, 0.05));
-    for (auto& triangle : triangles)
-        prims.push_back(new GeometricPrimitive(triangle, leftWallMaterial));
-
-    auto sphere1 = loadObjMesh("../assets/sphere1.obj");
-    triangles = createTriangleMesh(sphere1);
-    auto sphere1Material = std::make_shared<MatteMaterial>(Vector3(0.630, 0.065, 0.05));
-    for (auto& triangle : triangles)
-        prims.push_back(new GeometricPrimitive(triangle, sphere1Material));
-
-    auto sphere2 = loadObjMesh("../assets/sphere2.obj");
-    triangles = createTriangleMesh(sphere2);
-    auto sphere2Material = std::make_shared<MatteMaterial>(Vector3(0.161, 0.133, 0.427));
-    for (auto& triangle : triangles)
-        prims.push_back(new GeometricPrimitive(triangle, sphere2Material));
-
-    auto light = loadObjMesh("../assets/light.obj");
-    triangles = createTriangleMesh(light);
-    for (auto& triangle : triangles) {
-        auto light = std::make_shared<DiffuseAreaLight>(triangle, Vector3(10));
-        lights.push_back(light);
-        prims.push_back(new GeometricPrimitive(triangle, nullptr, light));
+// cbox                         renders on this machine
+// cbox coordinator <port>       hands tiles to workers and writes the image
+// cbox worker <host> <port>     renders the tiles of the coordinator at host
+// cbox shard <index> <count>    renders one shard, exrmerge combines shard*.exr
+// cbox trace <file>             renders on this machine and writes a Chrome trace of its threads
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    if ((mode == "coordinator" && argc != 3) || (mode == "worker" && argc != 4) || (mode == "shard" && argc != 4) ||
+        (mode == "trace" && argc != 3) ||
+        (mode != "" && mode != "coordinator" && mode != "worker" && mode != "shard" && mode != "trace")) {
+        std::cerr << "usage: cbox [coordinator <port> | worker <host> <port> | shard <index> <count> | trace <file>]"
+                  << std::endl;
+        return 1;
     }
+    if (mode == "trace") startTrace();
 
-    BVHAccel accel(std::move(prims));
-    Scene scene(accel, std::move(lights));
+    CornellBox box;
+    BVHAccel accel(std::move(box.prims));
+    Scene scene(accel, std::move(box.lights));
     auto filter = std::make_unique<BoxFilter>(0.5);
 
+    Vector2i resolution(800, 600);
+    auto shard = mode == "shard";
     Film film(
-        Vector2i(800, 600),
-        Bounds2f(Vector2f(0, 0), Vector2f(1, 1)),
-        std::move(filter)
+        resolution,
+        shard ? Film::getShardCropWindow(resolution, std::stoi(argv[2]), std::stoi(argv[3]))
+              : Bounds2f(Vector2f(0, 0), Vector2f(1, 1)),
+        std::move(filter),
+        false,
+        shard
     );
     PerspectiveCamera camera(
         Frame::scale(-1, 1, 1) * Frame::lookAt(
@@ -88,8 +69,22 @@ int main() {
 
     RandomSampler sampler(64);
     PathIntegrator integrator(5, camera, sampler);
-    integrator.render(scene);
-    film.writeImage("./image.png");
+    if (shard) integrator.setHeatmapPrefix("./traversal-shard" + std::string(argv[2]));
+    if (mode == "worker") {
+        integrator.renderWorker(scene, argv[2], (std::uint16_t)std::stoi(argv[3]));
+        return 0;
+    }
+    if (mode == "coordinator") integrator.renderCoordinator((std::uint16_t)std::stoi(argv[2]));
+    else integrator.render(scene);
+    if (shard) film.writeShard("./shard" + std::string(argv[2]) + ".exr");
+    else film.writeImage("./image.png");
+
+    if (mode == "trace") {
+        stopTrace();
+        writeTrace(argv[2]);
+    }
 
+    reportRenderStats(std::cout);
+    writeRenderStats("./stats.json");
     return 0;
 }
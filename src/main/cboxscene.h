@@ -0,0 +1,51 @@
+#ifndef PT_MAIN_CBOXSCENE_H
+#define PT_MAIN_CBOXSCENE_H
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <pt/utils/objloader.h>
+#include <pt/core/primitive.h>
+#include <pt/materials/matte.h>
+#include <pt/lights/diffuse.h>
+#include <pt/shapes/triangle.h>
+
+namespace pt {
+
+// the Cornell box rendered by cbox and server, the meshes are loaded from ../assets and
+// kept here, since the triangles of the primitives refer to them
+class CornellBox {
+public:
+    CornellBox() {
+        addMesh("../assets/walls.obj", Vector3(0.725, 0.71, 0.68));
+        addMesh("../assets/rightwall.obj", Vector3(0.161, 0.133, 0.427));
+        addMesh("../assets/leftwall.obj", Vector3(0.630, 0.065, 0.05));
+        addMesh("../assets/sphere1.obj", Vector3(0.630, 0.065, 0.05));
+        addMesh("../assets/sphere2.obj", Vector3(0.161, 0.133, 0.427));
+
+        meshes.push_back(std::make_unique<Mesh>(loadObjMesh("../assets/light.obj")));
+        for (auto& triangle : createTriangleMesh(*meshes.back())) {
+            auto light = std::make_shared<DiffuseAreaLight>(triangle, Vector3(10));
+            lights.push_back(light);
+            prims.push_back(new GeometricPrimitive(triangle, nullptr, light));
+        }
+    }
+
+private:
+    void addMesh(const std::string& filename, const Vector3& color) {
+        meshes.push_back(std::make_unique<Mesh>(loadObjMesh(filename)));
+        auto material = std::make_shared<MatteMaterial>(color);
+        for (auto& triangle : createTriangleMesh(*meshes.back()))
+            prims.push_back(new GeometricPrimitive(triangle, material));
+    }
+
+public:
+    std::vector<std::unique_ptr<Mesh>> meshes;
+    // handed to the BVH and the scene
+    std::vector<Primitive*> prims;
+    std::vector<std::shared_ptr<Light>> lights;
+};
+
+}
+
+#endif
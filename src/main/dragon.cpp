@@ -12,12 +12,17 @@ using namespace pt;
 class NormalIntegrator : public SamplerIntegrator {
 public:
     NormalIntegrator(Camera& camera, Sampler& sampler)
-        : SamplerIntegrator(camera, sampler)
+        : SamplerIntegrator(camera, sampler, true)
     { }
 
-    Vector3 li(const Ray& ray, const Scene& scene) const override {
+    Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler) const override {
         Interaction isect;
-        if (scene.intersect(ray, isect))
+        return li(ray, scene, sampler, isect, scene.intersect(ray, isect));
+    }
+
+    Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler, Interaction& isect,
+               bool foundIntersection) const override {
+        if (foundIntersection)
             return abs(isect.n);
         return Vector3(0);
     }
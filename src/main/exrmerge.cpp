@@ -0,0 +1,85 @@
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include <pt/utils/imageio.h>
+
+using namespace pt;
+
+// sums the shards written by Film::writeShard and writes the normalized frame, shards are
+// added in the order they are given, so the result does not depend on how they were rendered
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: exrmerge output.exr shard.exr..." << std::endl;
+        return 1;
+    }
+
+    try {
+        auto first = readChannelImage(argv[2]);
+        auto resolution = first.totalResolution;
+        auto channels = first.channels;
+        auto nChannels = channels.size();
+        std::map<std::string, std::size_t> channelIndices;
+        for (std::size_t c = 0; c < nChannels; ++c) channelIndices[channels[c]] = c;
+        for (auto name : { "R", "G", "B", "W" })
+            if (!channelIndices.count(name)) throw std::runtime_error(std::string("Shard has no channel ") + name + ": " + argv[2]);
+
+        Bounds2i frameBounds(Vector2i(0, 0), resolution);
+        std::vector<Float> sums((std::size_t)frameBounds.area() * nChannels, 0);
+        for (auto i = 2; i < argc; ++i) {
+            auto shard = i == 2 ? std::move(first) : readChannelImage(argv[i]);
+            if (shard.totalResolution.x != resolution.x || shard.totalResolution.y != resolution.y ||
+                shard.channels != channels)
+                throw std::runtime_error(std::string("Shard belongs to another frame: ") + argv[i]);
+            if (intersect(shard.bounds, frameBounds).area() != shard.bounds.area())
+                throw std::runtime_error(std::string("Shard lies outside of the frame: ") + argv[i]);
+
+            auto offset = (std::size_t)0;
+            for (auto p : shard.bounds) {
+                auto sum = &sums[((std::size_t)p.y * resolution.x + p.x) * nChannels];
+                for (std::size_t c = 0; c < nChannels; ++c) sum[c] += shard.values[offset++];
+            }
+        }
+
+        // layer channels are named layer.channel, every sum is divided by the filter weight
+        std::map<std::string, std::vector<std::size_t>> layerChannels;
+        for (std::size_t c = 0; c < nChannels; ++c) {
+            auto dot = channels[c].find('.');
+            if (dot != std::string::npos) layerChannels[channels[c].substr(0, dot)].push_back(c);
+        }
+
+        auto count = (std::size_t)frameBounds.area();
+        std::vector<Float> rgbs(3 * count);
+        std::vector<std::vector<Float>> buffers;
+        std::vector<ImageLayer> layers;
+        for (auto& layer : layerChannels) {
+            std::vector<std::string> names;
+            for (auto c : layer.second) names.push_back(channels[c].substr(layer.first.size() + 1));
+            buffers.emplace_back(count * names.size());
+            layers.push_back(ImageLayer { layer.first, names, nullptr });
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            auto sum = &sums[i * nChannels];
+            auto weight = sum[channelIndices["W"]];
+            auto invWeight = weight != 0 ? 1 / weight : 0;
+            rgbs[3 * i + 0] = sum[channelIndices["R"]] * invWeight;
+            rgbs[3 * i + 1] = sum[channelIndices["G"]] * invWeight;
+            rgbs[3 * i + 2] = sum[channelIndices["B"]] * invWeight;
+            auto buffer = buffers.begin();
+            for (auto& layer : layerChannels) {
+                for (std::size_t c = 0; c < layer.second.size(); ++c)
+                    (*buffer)[i * layer.second.size() + c] = sum[layer.second[c]] * invWeight;
+                ++buffer;
+            }
+        }
+        for (std::size_t l = 0; l < layers.size(); ++l) layers[l].values = buffers[l].data();
+
+        writeImage(argv[1], rgbs.data(), layers, frameBounds, resolution);
+        std::cout << argc - 2 << " shards -> " << argv[1] << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
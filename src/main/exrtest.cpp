@@ -0,0 +1,127 @@
+#include <cmath>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include <iostream>
+#include <pt/core/scene.h>
+#include <pt/core/integrator.h>
+#include <pt/samplers/random.h>
+#include <pt/cameras/perspective.h>
+#include <pt/accelerators/bvh.h>
+#include <pt/shapes/triangle.h>
+#include <pt/filters/triangle.h>
+#include <pt/utils/imageio.h>
+
+using namespace pt;
+
+class NormalIntegrator : public SamplerIntegrator {
+public:
+    NormalIntegrator(Camera& camera, Sampler& sampler)
+        : SamplerIntegrator(camera, sampler, true)
+    { }
+
+    Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler) const override {
+        Interaction isect;
+        return li(ray, scene, sampler, isect, scene.intersect(ray, isect));
+    }
+
+    Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler, Interaction& isect,
+               bool foundIntersection) const override {
+        if (foundIntersection)
+            return abs(isect.n);
+        return Vector3(0);
+    }
+};
+
+static const Vector2i resolution(200, 150);
+static const int nShards = 3;
+
+static const Bounds2f fullFrame(Vector2f(0, 0), Vector2f(1, 1));
+
+// the filter reaches past a pixel, so that shards overlap and streamed output tiles wait
+// for the samples of their neighbours
+static std::unique_ptr<Film> createFilm(const Bounds2f& cropWindow, bool shard) {
+    auto film = std::make_unique<Film>(resolution, cropWindow, std::make_unique<TriangleFilter>(1.5), false, shard);
+    film->enableAOV(AOVDepth);
+    film->enableAOV(AOVNormal);
+    return film;
+}
+
+static void render(const Scene& scene, Film& film) {
+    PerspectiveCamera camera(
+        Frame::lookAt(Vector3(1, 2, -6), Vector3(0, 0, 0), Vector3(0, 1, 0)),
+        film,
+        Bounds2f(Vector2f(-1, -0.75), Vector2f(1, 0.75)),
+        0, 0, 45
+    );
+    RandomSampler sampler(16, 7);
+    NormalIntegrator integrator(camera, sampler);
+    integrator.render(scene);
+}
+
+// RGB is stored as half, layers as float, values only differ by the order samples were
+// summed in
+static bool compare(const std::string& name, const ChannelImage& image, const ChannelImage& reference) {
+    if (image.channels != reference.channels || image.totalResolution.x != reference.totalResolution.x ||
+        image.totalResolution.y != reference.totalResolution.y ||
+        image.bounds.pMin != reference.bounds.pMin || image.bounds.pMax != reference.bounds.pMax) {
+        std::cout << name << ": channels or bounds differ" << std::endl;
+        return false;
+    }
+    auto nChannels = image.channels.size();
+    auto maxError = (Float)0;
+    for (std::size_t i = 0; i < image.values.size(); ++i) {
+        auto& channel = image.channels[i % nChannels];
+        auto tolerance = channel == "R" || channel == "G" || channel == "B" ? (Float)2e-3 : (Float)1e-4;
+        auto a = image.values[i], b = reference.values[i];
+        auto error = std::abs(a - b) / std::max({ std::abs(a), std::abs(b), (Float)1e-3 });
+        maxError = std::max(maxError, error / tolerance);
+    }
+    std::cout << name << ": " << nChannels << " channels, largest difference "
+              << maxError * 100 << "% of the tolerance" << std::endl;
+    return maxError <= 1;
+}
+
+// writes the same frame as one image, streamed tile by tile while rendering and as shards
+// merged by exrmerge, which must sit next to this executable, and reads them back
+int main(int argc, char** argv) {
+    Mesh floorMesh({ 0, 1, 2, 0, 2, 3 }, { Vector3(-4, -1, -4), Vector3(4, -1, -4), Vector3(4, -1, 4), Vector3(-4, -1, 4) });
+    Mesh boxMesh({ 0, 1, 2, 0, 2, 3 }, { Vector3(-1, -1, 0), Vector3(1, -1, 1), Vector3(1, 1.5, 1), Vector3(-1, 1.5, 0) });
+    std::vector<Primitive*> primitives;
+    for (auto& triangle : createTriangleMesh(floorMesh)) primitives.push_back(new GeometricPrimitive(triangle));
+    for (auto& triangle : createTriangleMesh(boxMesh)) primitives.push_back(new GeometricPrimitive(triangle));
+    BVHAccel accel(std::move(primitives));
+    Scene scene(accel);
+
+    try {
+        auto full = createFilm(fullFrame, false);
+        render(scene, *full);
+        full->writeImage("./exrtest-full.exr");
+
+        // the last output tile is written while rendering, the file is closed with the film
+        auto streamed = createFilm(fullFrame, false);
+        streamed->streamImage("./exrtest-streamed.exr");
+        render(scene, *streamed);
+        streamed.reset();
+
+        std::string command(argv[0]);
+        command = command.substr(0, command.find_last_of('/') + 1) + "exrmerge ./exrtest-merged.exr";
+        for (auto i = 0; i < nShards; ++i) {
+            auto shard = createFilm(Film::getShardCropWindow(resolution, i, nShards), true);
+            render(scene, *shard);
+            auto filename = "./exrtest-shard" + std::to_string(i) + ".exr";
+            shard->writeShard(filename);
+            command += " " + filename;
+        }
+        if (std::system(command.c_str()) != 0) throw std::runtime_error("Failed to run " + command);
+
+        auto reference = readChannelImage("./exrtest-full.exr");
+        auto ok = compare("streamed", readChannelImage("./exrtest-streamed.exr"), reference);
+        ok = compare("merged shards", readChannelImage("./exrtest-merged.exr"), reference) && ok;
+        std::cout << (ok ? "OK" : "FAILED") << std::endl;
+        return ok ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,36 @@
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <pt/utils/objloader.h>
+#include <pt/utils/plyloader.h>
+#include <pt/utils/ptmloader.h>
+
+using namespace pt;
+
+static bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || (argc == 4 && std::strcmp(argv[3], "--compress")) || argc > 4) {
+        std::cerr << "usage: ptmconvert input.(obj|ply) output.ptm [--compress]" << std::endl;
+        return 1;
+    }
+
+    std::string input = argv[1], output = argv[2];
+    auto compress = argc == 4;
+    try {
+        if (!endsWith(input, ".obj") && !endsWith(input, ".ply"))
+            throw std::runtime_error("Unknown mesh format: " + input);
+        auto mesh = endsWith(input, ".obj") ? loadObjMesh(input) : loadPLYMesh(input);
+
+        writePtmMesh(output, mesh, compress);
+        std::cout << input << ": " << mesh.vertices.size() << " vertices, "
+                  << mesh.indices.size() / 3 << " triangles -> " << output << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
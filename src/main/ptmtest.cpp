@@ -0,0 +1,122 @@
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <iostream>
+#include <pt/utils/ptmloader.h>
+#include <pt/samplers/random.h>
+
+using namespace pt;
+
+static auto failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cout << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+static bool sameMesh(const Mesh& a, const Mesh& b, Float normalTolerance) {
+    if (a.indices.size() != b.indices.size() || a.vertices.size() != b.vertices.size() ||
+        a.normals.size() != b.normals.size() || a.uvs.size() != b.uvs.size())
+        return false;
+    for (std::size_t i = 0; i < a.indices.size(); ++i)
+        if (a.indices[i] != b.indices[i]) return false;
+    for (std::size_t i = 0; i < a.vertices.size(); ++i)
+        if (a.vertices[i] != b.vertices[i]) return false;
+    for (std::size_t i = 0; i < a.uvs.size(); ++i)
+        if (a.uvs[i].x != b.uvs[i].x || a.uvs[i].y != b.uvs[i].y) return false;
+    for (std::size_t i = 0; i < a.normals.size(); ++i)
+        if (dot(a.normals[i], b.normals[i]) < 1 - normalTolerance) return false;
+    return true;
+}
+
+// a bumpy grid with normals and uvs, indices jump across the grid so that the compressed
+// stream holds negative deltas and multi byte varints
+static Mesh createTestMesh(int n) {
+    std::vector<Vector3> vertices, normals;
+    std::vector<Vector2f> uvs;
+    for (auto y = 0; y <= n; ++y) {
+        for (auto x = 0; x <= n; ++x) {
+            auto u = (float)x / n, v = (float)y / n;
+            vertices.emplace_back(u, (float)std::sin(u * 7) * 0.1f, v);
+            normals.push_back(normalize(Vector3(-std::cos(u * 7) * 0.7f, 1, 0)));
+            uvs.emplace_back(u, v);
+        }
+    }
+    std::vector<int> indices;
+    for (auto y = 0; y < n; ++y) {
+        for (auto x = 0; x < n; ++x) {
+            auto i = y * (n + 1) + x;
+            indices.insert(indices.end(), { i, i + 1, i + n + 1, i + 1, i + n + 2, i + n + 1 });
+        }
+    }
+    indices.insert(indices.end(), { 0, (int)vertices.size() - 1, n });
+    return Mesh(std::move(indices), std::move(vertices), std::move(normals), std::move(uvs));
+}
+
+// writes meshes to .ptm and loads them back, uncompressed and compressed
+int main() {
+    RandomSampler sampler(1);
+
+    // octahedral normals, random directions and the axes, whose signs flip the fold
+    auto maxAngle = (Float)0;
+    std::vector<Vector3> directions = {
+        Vector3(1, 0, 0), Vector3(-1, 0, 0), Vector3(0, 1, 0), Vector3(0, -1, 0), Vector3(0, 0, 1), Vector3(0, 0, -1)
+    };
+    for (auto i = 0; i < 100000; ++i) {
+        auto u = sampler.get2D();
+        auto z = 1 - 2 * u.x, r = std::sqrt(std::max((Float)0, 1 - z * z)), phi = 2 * Pi * u.y;
+        directions.emplace_back(r * std::cos(phi), r * std::sin(phi), z);
+    }
+    for (auto& n : directions) {
+        std::int16_t encoded[2];
+        encodeOctahedral(n, encoded);
+        // acos loses the small angles near 1 in float precision
+        auto decoded = decodeOctahedral(encoded);
+        maxAngle = std::max(maxAngle, std::atan2(cross(n, decoded).length(), dot(n, decoded)));
+    }
+    std::cout << "octahedral normals: max error " << maxAngle * 180 / Pi << " degrees" << std::endl;
+    check(maxAngle < (Float)1e-4, "octahedral normals");
+
+    // zigzag varints over the whole index range
+    std::vector<int> extremes = { 0, std::numeric_limits<int>::max(), 0, 1, 0, 127, 128, 16383, 16384,
+                                  std::numeric_limits<int>::max() - 1, 5, std::numeric_limits<int>::max() };
+    for (auto i = 0; i < 1000; ++i) extremes.push_back((int)(sampler.get1D() * std::numeric_limits<int>::max()));
+    auto bytes = compressIndices(Buffer<int>(std::vector<int>(extremes)));
+    auto decompressed = decompressIndices(reinterpret_cast<const char*>(bytes.data()), bytes.size(), extremes.size());
+    check(decompressed == extremes, "zigzag varint indices");
+    bytes.pop_back();
+    try {
+        decompressIndices(reinterpret_cast<const char*>(bytes.data()), bytes.size(), extremes.size());
+        check(false, "truncated varint stream is rejected");
+    } catch (const std::runtime_error&) { }
+
+    auto mesh = createTestMesh(300);
+    for (auto compress : { false, true }) {
+        auto name = compress ? "compressed" : "uncompressed";
+        auto filename = std::string("./ptmtest-") + name + ".ptm";
+        writePtmMesh(filename, mesh, compress);
+
+        std::unique_ptr<Mesh> copy;
+        {
+            auto loaded = loadPtmMesh(filename);
+            check(sameMesh(mesh, loaded, (Float)1e-6), std::string(name) + " round trip");
+            if (sizeof(Float) == sizeof(float)) {
+                check(loaded.vertices.isBorrowed() && loaded.uvs.isBorrowed(), std::string(name) + " positions and uvs are borrowed");
+                check(loaded.indices.isBorrowed() != compress, std::string(name) + " indices are borrowed when uncompressed");
+            }
+            copy = std::make_unique<Mesh>(loaded);
+        }
+
+        // the copy keeps the mapping alive after the loaded mesh and the file are gone
+        std::remove(filename.c_str());
+        check(sameMesh(mesh, *copy, (Float)1e-6), std::string(name) + " copy outlives the loaded mesh");
+        std::cout << name << ": " << copy->vertices.size() << " vertices, " << copy->indices.size() / 3
+                  << " triangles" << std::endl;
+    }
+
+    std::cout << (failures ? "FAILED" : "OK") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <pt/utils/socket.h>
+#include <pt/core/scene.h>
+#include <pt/core/parallel.h>
+#include <pt/accelerators/bvh.h>
+#include <pt/cameras/perspective.h>
+#include <pt/samplers/random.h>
+#include <pt/integrators/path.h>
+#include <pt/filters/box.h>
+#include "cboxscene.h"
+
+using namespace pt;
+
+// a render job, the camera looks from eye at target like the camera of cbox
+struct RenderJob {
+    std::string filename;
+    Vector2i resolution;
+    std::int64_t samplesPerPixel;
+    int maxDepth;
+    Vector3 eye, target, up;
+    Float fov;
+};
+
+static RenderJob parseJob(std::istringstream& in) {
+    RenderJob job;
+    in >> job.filename >> job.resolution.x >> job.resolution.y >> job.samplesPerPixel >> job.maxDepth
+       >> job.eye.x >> job.eye.y >> job.eye.z
+       >> job.target.x >> job.target.y >> job.target.z
+       >> job.up.x >> job.up.y >> job.up.z >> job.fov;
+    std::string rest;
+    if (!in || in >> rest)
+        throw std::runtime_error("expected render <output> <width> <height> <spp> <depth> "
+                                 "<eye xyz> <target xyz> <up xyz> <fov>");
+    if (job.resolution.x <= 0 || job.resolution.y <= 0 || job.samplesPerPixel <= 0 || job.maxDepth <= 0)
+        throw std::runtime_error("resolution, spp and depth must be positive");
+    // a job names a file in the output directory, not a path, so a client can not write
+    // anywhere else the server's user can
+    if (job.filename.empty() || job.filename[0] == '.' || job.filename.find_first_of("/\\") != std::string::npos)
+        throw std::runtime_error("output must be a file name without a directory");
+    return job;
+}
+
+// only the film, camera and sampler belong to a job, the scene and the worker threads stay
+static void render(const Scene& scene, const RenderJob& job, const std::string& outputDirectory) {
+    auto aspect = (Float)job.resolution.y / job.resolution.x;
+    Film film(
+        job.resolution,
+        Bounds2f(Vector2f(0, 0), Vector2f(1, 1)),
+        std::make_unique<BoxFilter>(0.5)
+    );
+    PerspectiveCamera camera(
+        Frame::scale(-1, 1, 1) * Frame::lookAt(job.eye, job.target, job.up),
+        film,
+        Bounds2f(Vector2f(-1, -aspect), Vector2f(1, aspect)),
+        0, 0, job.fov
+    );
+
+    RandomSampler sampler(job.samplesPerPixel);
+    PathIntegrator integrator(job.maxDepth, camera, sampler);
+    integrator.render(scene);
+    film.writeImage(outputDirectory + "/" + job.filename);
+}
+
+// keeps the Cornell box loaded and renders the jobs sent to port on this machine, one line
+// per command, a client runs one job after the other and is answered once each image is
+// written to the output directory, for example
+//
+//   render image.png 800 600 64 5 0 0.92 -5.41 0 0.89 -4.41 0 1 0 27.79
+//   ok 12.3
+//   quit
+//
+// there is no authentication, any local client can overwrite the files of the output
+// directory, so it should hold nothing else
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "usage: server <port> <output directory>" << std::endl;
+        return 1;
+    }
+    std::string outputDirectory(argv[2]);
+
+    // the outermost init keeps the worker threads alive across the scene build and every job
+    parallelInit();
+
+    CornellBox box;
+    BVHAccel accel(std::move(box.prims));
+    Scene scene(accel, std::move(box.lights));
+
+    // jobs take every thread, so clients are served one at a time
+    auto listener = Socket::listen((std::uint16_t)std::stoi(argv[1]), true);
+    std::cout << "listening on port " << argv[1] << std::endl;
+    auto running = true;
+    while (running) {
+        auto client = listener.accept(-1);
+        if (!client.valid()) continue;
+        try {
+            std::string line;
+            while (running && client.recvLine(line)) {
+                std::istringstream in(line);
+                std::string command;
+                in >> command;
+                if (command.empty()) continue;
+                if (command == "quit") {
+                    running = false;
+                    client.sendLine("ok");
+                    continue;
+                }
+                if (command != "render") {
+                    client.sendLine("error unknown command " + command);
+                    continue;
+                }
+
+                try {
+                    auto job = parseJob(in);
+                    auto start = std::chrono::steady_clock::now();
+                    render(scene, job, outputDirectory);
+                    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    std::ostringstream reply;
+                    reply << "ok " << seconds;
+                    client.sendLine(reply.str());
+                } catch (const std::exception& e) {
+                    client.sendLine(std::string("error ") + e.what());
+                }
+            }
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Client dropped: " << e.what() << std::endl;
+        }
+    }
+
+    parallelCleanup();
+    return 0;
+}
@@ -1,3 +1,4 @@
+#include <iostream>
 #include <pt/utils/objloader.h>
 #include <pt/core/scene.h>
 #include <pt/materials/matte.h>
@@ -99,10 +100,18 @@ int main() {
         0, 0, 35
     );
 
-    RandomSampler sampler(512);
+    // the denoiser gets the image of 512 samples per pixel out of 64
+    film.enableDenoiserAOVs();
+    RandomSampler sampler(64);
     PathIntegrator integrator(20, camera, sampler);
+    // a preempted render continues from the last checkpoint when started again
+    integrator.enableCheckpoints("./image.checkpoint", 8, 600);
     integrator.render(scene);
+    film.denoise(sampler.samplesPerPixel);
     film.writeImage("./image.exr");
+    integrator.removeCheckpoint();
 
+    reportRenderStats(std::cout);
+    writeRenderStats("./stats.json");
     return 0;
 }
@@ -0,0 +1,190 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <cstring>
+#include <iostream>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include <pt/core/scene.h>
+#include <pt/core/integrator.h>
+#include <pt/samplers/random.h>
+#include <pt/cameras/perspective.h>
+#include <pt/accelerators/bvh.h>
+#include <pt/shapes/triangle.h>
+#include <pt/utils/plyloader.h>
+#include <pt/filters/box.h>
+
+using namespace pt;
+
+class NormalIntegrator : public SamplerIntegrator {
+public:
+    NormalIntegrator(Camera& camera, Sampler& sampler)
+        : SamplerIntegrator(camera, sampler, true)
+    { }
+
+    Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler) const override {
+        Interaction isect;
+        return li(ray, scene, sampler, isect, scene.intersect(ray, isect));
+    }
+
+    Vector3 li(const Ray& ray, const Scene& scene, Sampler& sampler, Interaction& isect,
+               bool foundIntersection) const override {
+        if (foundIntersection)
+            return abs(isect.n);
+        return Vector3(0);
+    }
+};
+
+#ifdef __linux__
+// last level cache read misses of this process, threads started after the counter is opened
+// are counted too, their counts are added when they exit, the render's worker threads are
+// joined before the counter is read
+class CacheMissCounter {
+public:
+    CacheMissCounter() {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        error = fd == -1 ? errno : 0;
+    }
+
+    ~CacheMissCounter() {
+        if (fd != -1) close(fd);
+    }
+
+    // without permission to open the counter, for example in a container, misses are not counted
+    bool valid() const {
+        return fd != -1;
+    }
+
+    const char* reason() const {
+        return std::strerror(error);
+    }
+
+    void start() {
+        if (fd == -1) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    std::uint64_t stop() {
+        if (fd == -1) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        std::uint64_t count = 0;
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) return 0;
+        return count;
+    }
+
+private:
+    int fd;
+    int error;
+};
+#else
+// perf events only exist on Linux, elsewhere misses are not counted
+class CacheMissCounter {
+public:
+    bool valid() const {
+        return false;
+    }
+
+    const char* reason() const {
+        return "perf events need Linux";
+    }
+
+    void start() { }
+
+    std::uint64_t stop() {
+        return 0;
+    }
+};
+#endif
+
+// renders the dragon with every tile order and reports the fastest of a few frames and its
+// last level cache misses, the orders are compared without sorting the tiles by their
+// estimated cost, which the renderer does by default and which leaves the tile order to
+// decide only among tiles of the same power of two cost, the default is reported last
+int main(int argc, char** argv) {
+    auto samplesPerPixel = argc > 1 ? std::stoi(argv[1]) : 4;
+    auto nFrames = argc > 2 ? std::stoi(argv[2]) : 3;
+
+    auto dragon = Mesh(
+        Frame::rotate(Vector3(0, 1, 0), -53),
+        loadPLYMesh("../assets/dragon.ply")
+    );
+    auto triangles = createTriangleMesh(dragon);
+    std::vector<Primitive*> primitives;
+    for (auto& triangle : triangles)
+        primitives.push_back(new GeometricPrimitive(triangle));
+    BVHAccel accel(std::move(primitives));
+    Scene scene(accel);
+
+    struct Order {
+        const char* name;
+        TileOrder order;
+        int groupSize;
+        bool costSorting;
+    };
+    const Order orders[] = {
+        { "row-major", TileOrder::RowMajor, 1, false },
+        { "hilbert", TileOrder::Hilbert, 1, false },
+        { "hilbert, groups of 4", TileOrder::Hilbert, 4, false },
+        { "hilbert, cost sorted", TileOrder::Hilbert, 1, true },
+    };
+
+    CacheMissCounter counter;
+    if (!counter.valid()) std::cout << "cache misses are not available: " << counter.reason() << std::endl;
+    std::cout << "tiles are not sorted by estimated cost unless the order says so" << std::endl;
+    std::printf("%-22s %12s %16s\n", "order", "frame (ms)", "LLC misses");
+    for (auto& order : orders) {
+        auto bestTime = 0.0;
+        std::uint64_t bestMisses = 0;
+        for (auto frame = 0; frame < nFrames; ++frame) {
+            Film film(
+                Vector2i(800, 800),
+                Bounds2f(Vector2f(0, 0), Vector2f(1, 1)),
+                std::make_unique<BoxFilter>(0.5)
+            );
+            PerspectiveCamera camera(
+                Frame::lookAt(
+                    Vector3(277, -240, 250),
+                    Vector3(0, 60, -30),
+                    Vector3(0, 0, 1)
+                ),
+                film,
+                Bounds2f(Vector2f(-1, -1), Vector2f(1, 1)),
+                0, 0, 30
+            );
+            RandomSampler sampler(samplesPerPixel);
+            NormalIntegrator integrator(camera, sampler);
+            integrator.setTileOrder(order.order, order.groupSize);
+            integrator.setCostSorting(order.costSorting);
+
+            counter.start();
+            auto start = std::chrono::steady_clock::now();
+            integrator.render(scene);
+            auto time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            auto misses = counter.stop();
+            if (frame == 0 || time < bestTime) {
+                bestTime = time;
+                bestMisses = misses;
+            }
+        }
+        auto misses = counter.valid() ? std::to_string(bestMisses) : "n/a";
+        std::printf("%-22s %12.1f %16s\n", order.name, bestTime, misses.c_str());
+    }
+
+    return 0;
+}
@@ -1,3 +1,5 @@
+#include <mutex>
+#include <vector>
 #include <fstream>
 #include <experimental/filesystem>
 #include <pt/math/math.h>
@@ -5,6 +7,13 @@
 #include <lodepng/lodepng.h>
 #include <ImfRgba.h>
 #include <ImfRgbaFile.h>
+#include <ImfHeader.h>
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfOutputFile.h>
+#include <ImfInputFile.h>
+#include <ImfTiledOutputFile.h>
+#include <half.h>
 
 namespace fs = std::experimental::filesystem;
 
@@ -110,4 +119,184 @@ void writeImage(const std::string& filename, const Float* rgbs,
     }
 }
 
+// half RGB and float layer values of the pixels in bounds, the frame buffer addresses
+// them by absolute pixel coordinates
+class ExrPixels {
+public:
+    ExrPixels(const Bounds2i& bounds, const Float* rgbs, const std::vector<ImageLayer>& layers) {
+        using namespace Imf;
+        auto n = (std::size_t)bounds.area();
+        auto width = (std::size_t)bounds.diag().x;
+        auto origin = bounds.pMin.x + bounds.pMin.y * (std::ptrdiff_t)width;
+
+        rgbHalfs.resize(3 * n);
+        for (std::size_t i = 0; i < 3 * n; ++i) rgbHalfs[i] = half((float)rgbs[i]);
+        const char* rgbNames[] = { "R", "G", "B" };
+        for (auto c = 0; c < 3; ++c) {
+            frameBuffer.insert(rgbNames[c], Slice(HALF,
+                (char*)(&rgbHalfs[c] - 3 * origin), 3 * sizeof(half), 3 * sizeof(half) * width));
+        }
+
+        // reserved up front, the slices point into these vectors
+        layerFloats.reserve(layers.size());
+        for (auto& layer : layers) {
+            auto nChannels = layer.channels.size();
+            layerFloats.emplace_back(nChannels * n);
+            auto& floats = layerFloats.back();
+            for (std::size_t i = 0; i < nChannels * n; ++i) floats[i] = (float)layer.values[i];
+            for (std::size_t c = 0; c < nChannels; ++c) {
+                frameBuffer.insert(layer.name + "." + layer.channels[c], Slice(FLOAT,
+                    (char*)(&floats[c] - nChannels * origin), nChannels * sizeof(float), nChannels * sizeof(float) * width));
+            }
+        }
+    }
+
+    static void insertChannels(Imf::Header& header, const std::vector<ImageLayer>& layers) {
+        using namespace Imf;
+        header.channels().insert("R", Channel(HALF));
+        header.channels().insert("G", Channel(HALF));
+        header.channels().insert("B", Channel(HALF));
+        for (auto& layer : layers)
+            for (auto& channel : layer.channels)
+                header.channels().insert(layer.name + "." + channel, Channel(FLOAT));
+    }
+
+public:
+    Imf::FrameBuffer frameBuffer;
+
+private:
+    std::vector<half> rgbHalfs;
+    std::vector<std::vector<float>> layerFloats;
+};
+
+// slices of float channels interleaved per pixel, addressed by absolute pixel coordinates
+static Imf::FrameBuffer channelFrameBuffer(const std::vector<std::string>& channels, float* floats,
+                                           const Bounds2i& bounds) {
+    using namespace Imf;
+    auto nChannels = channels.size();
+    auto width = (std::size_t)bounds.diag().x;
+    auto origin = bounds.pMin.x + bounds.pMin.y * (std::ptrdiff_t)width;
+    FrameBuffer frameBuffer;
+    for (std::size_t c = 0; c < nChannels; ++c) {
+        frameBuffer.insert(channels[c], Slice(FLOAT,
+            (char*)(floats + c - nChannels * origin), nChannels * sizeof(float), nChannels * sizeof(float) * width));
+    }
+    return frameBuffer;
+}
+
+void writeChannelImage(const std::string& filename, const ChannelImage& image) {
+    using namespace Imf;
+    using namespace Imath;
+    if (fs::path(filename).extension() != ".exr")
+        throw std::runtime_error("Channel images can only be written to EXR files!");
+    if (image.bounds.area() <= 0) throw std::runtime_error("Channel image is empty!");
+
+    auto& bounds = image.bounds;
+    Box2i displayWindow(V2i(0, 0), V2i(image.totalResolution.x - 1, image.totalResolution.y - 1));
+    Box2i dataWindow(V2i(bounds.pMin.x, bounds.pMin.y), V2i(bounds.pMax.x - 1, bounds.pMax.y - 1));
+    Header header(displayWindow, dataWindow);
+    for (auto& channel : image.channels) header.channels().insert(channel, Channel(FLOAT));
+
+    std::vector<float> floats(image.values.begin(), image.values.end());
+    OutputFile file(filename.c_str(), header);
+    file.setFrameBuffer(channelFrameBuffer(image.channels, &floats[0], bounds));
+    file.writePixels(bounds.diag().y);
+}
+
+ChannelImage readChannelImage(const std::string& filename) {
+    using namespace Imf;
+    InputFile file(filename.c_str());
+    auto& header = file.header();
+    auto& dataWindow = header.dataWindow();
+    auto& displayWindow = header.displayWindow();
+
+    ChannelImage image;
+    image.bounds = Bounds2i(Vector2i(dataWindow.min.x, dataWindow.min.y),
+                            Vector2i(dataWindow.max.x + 1, dataWindow.max.y + 1));
+    image.totalResolution = Vector2i(displayWindow.max.x + 1, displayWindow.max.y + 1);
+    for (auto it = header.channels().begin(); it != header.channels().end(); ++it)
+        image.channels.push_back(it.name());
+    if (image.bounds.area() <= 0 || image.channels.empty()) throw std::runtime_error("Channel image is empty: " + filename);
+
+    std::vector<float> floats(image.channels.size() * image.bounds.area());
+    file.setFrameBuffer(channelFrameBuffer(image.channels, &floats[0], image.bounds));
+    file.readPixels(dataWindow.min.y, dataWindow.max.y);
+    image.values.assign(floats.begin(), floats.end());
+    return image;
+}
+
+static Imf::Header exrHeader(const Bounds2i& outputBounds, const Vector2i& totalResolution,
+                             const std::vector<ImageLayer>& layers) {
+    using namespace Imf;
+    using namespace Imath;
+    Box2i displayWindow(V2i(0, 0), V2i(totalResolution.x - 1, totalResolution.y - 1));
+    Box2i dataWindow(V2i(outputBounds.pMin.x, outputBounds.pMin.y),
+                     V2i(outputBounds.pMax.x - 1, outputBounds.pMax.y - 1));
+    Header header(displayWindow, dataWindow);
+    ExrPixels::insertChannels(header, layers);
+    return header;
+}
+
+static void writeImageLayersEXR(const std::string& filename, const Float* rgbs, const std::vector<ImageLayer>& layers,
+                                const Bounds2i& outputBounds, const Vector2i& totalResolution) {
+    using namespace Imf;
+    OutputFile file(filename.c_str(), exrHeader(outputBounds, totalResolution, layers));
+    ExrPixels pixels(outputBounds, rgbs, layers);
+    file.setFrameBuffer(pixels.frameBuffer);
+    file.writePixels(outputBounds.diag().y);
+}
+
+void writeImage(const std::string& filename, const Float* rgbs, const std::vector<ImageLayer>& layers,
+                const Bounds2i& outputBounds, const Vector2i& totalResolution) {
+    if (layers.empty()) {
+        writeImage(filename, rgbs, outputBounds, totalResolution);
+    } else if (fs::path(filename).extension() == ".exr") {
+        writeImageLayersEXR(filename, rgbs, layers, outputBounds, totalResolution);
+    } else {
+        throw std::runtime_error("Image layers can only be written to EXR files!");
+    }
+}
+
+struct TiledImageWriter::Impl {
+    std::mutex mutex;
+    std::unique_ptr<Imf::TiledOutputFile> file;
+    Bounds2i outputBounds;
+    int tileSize;
+    int tilesLeft;
+};
+
+TiledImageWriter::TiledImageWriter(
+    const std::string& filename, const Bounds2i& outputBounds, const Vector2i& totalResolution,
+    int tileSize, const std::vector<ImageLayer>& layers) : impl(new Impl()) {
+
+    using namespace Imf;
+    if (fs::path(filename).extension() != ".exr")
+        throw std::runtime_error("Streamed output images must be EXR files!");
+
+    auto header = exrHeader(outputBounds, totalResolution, layers);
+    header.setTileDescription(TileDescription(tileSize, tileSize, ONE_LEVEL));
+    // with increasing y the library holds back tiles written out of order until the
+    // tiles above them arrive, random y stores them as they come
+    header.lineOrder() = RANDOM_Y;
+    impl->file.reset(new TiledOutputFile(filename.c_str(), header));
+
+    auto diag = outputBounds.diag();
+    impl->outputBounds = outputBounds;
+    impl->tileSize = tileSize;
+    impl->tilesLeft = ((diag.x + tileSize - 1) / tileSize) * ((diag.y + tileSize - 1) / tileSize);
+}
+
+TiledImageWriter::~TiledImageWriter() = default;
+
+void TiledImageWriter::writeTile(const Bounds2i& bounds, const Float* rgbs, const std::vector<ImageLayer>& layers) {
+    ExrPixels pixels(bounds, rgbs, layers);
+
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->file->setFrameBuffer(pixels.frameBuffer);
+    impl->file->writeTile((bounds.pMin.x - impl->outputBounds.pMin.x) / impl->tileSize,
+                          (bounds.pMin.y - impl->outputBounds.pMin.y) / impl->tileSize);
+    // closing the file writes the tile offset table
+    if (--impl->tilesLeft == 0) impl->file.reset();
+}
+
 }